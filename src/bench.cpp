@@ -0,0 +1,122 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hash.h"
+#include "notation.h"
+#include "threading.h"
+#include "utils.h"
+
+namespace {
+
+// in the format of the UCI position command
+const char* POSITIONS[] = {
+    // README tricky positions; the first one, kiwipete, is also in the perft suite
+    "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "fen r1b1k2r/pppp1ppp/1qn5/2b5/3n4/1P3N2/PBP1PPPP/RN1QKB1R w KQkq - 0 1",
+    "startpos moves b1c3 b8c6 e2e3 e7e6 g1f3 g8f6 f1d3 f8d6 c3e4 c6b4 e1e2 f6e4 d3e4 d8f6 g2g4 h7h6 "
+    "d1f1 e8e7 f1h3 h8e8 h1e1 b4a6 d2d4 c7c6 c1d2 a6c7 d2c3 c7b5 c3a5 b7b6 a5d2 b5c7 e4d3 c8b7 e3e4 "
+    "c6c5 d4c5 d6c5 d2c3 f6g6 h3h4 f7f6 e4e5 g6f7 e5f6 g7f6 f3e5 f7g8 e5g6 e7d8 h4f6 d8c8 f6g7 c7d5 "
+    "c3e5 d5b4 g7g8 e8g8 g6f4 g8g4 e2f1 g4h4 f4g6 h4h3 e5g3 b4d3 c2d3 c5b4 e1c1 b7c6 g6f4 h3g3 h2g3 "
+    "c8b7 f1e2 a8e8 c1c4 b4d6 f4g6 e8g8 g6h4 c6d5 c4c1 d6g3 f2g3 g8g3 e2f2 g3g4 c1h1 d5h1 a1h1 g4b4 "
+    "b2b3 b4b5 h4f3 b5a5 h1a1 b7c6 f2g3 c6d6 f3d2 d6d5 d2c4 a5a6 g3f4 h6h5 f4g5 b6b5 c4d2 b5b4 d2f3 "
+    "a6a5 g5h5 d5d6 h5g4 d6e7 g4f4 e7f6",
+    "startpos moves b2b3 c7c5 g1f3 b8c6 e2e3 e7e6 e1e2 c5c4 b3c4 e6e5 b1c3 g8f6 d1e1 e5e4",
+    "startpos moves e2e3 b8c6 g1f3",
+    // the rest of the perft suite (test/perft.sh)
+    "startpos",
+    "fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "fen r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "fen r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+constexpr int N_POSITIONS = sizeof(POSITIONS) / sizeof(POSITIONS[0]);
+
+Position parse_position(const std::string& str) {
+    std::istringstream iss(str);
+    std::string token;
+    iss >> token;
+    Position pos;
+    if (token == "fen") {
+        pos.load_fen(iss);
+        iss >> token;
+    } else {
+        iss >> token;
+    }
+    std::string move_str;
+    while (iss >> move_str) {
+        pos.make_move(notation::parse_uci_move(pos, move_str));
+    }
+    return pos;
+}
+
+struct PositionResult {
+    Position pos;
+    unsigned long nodes;
+    Move best_move;
+};
+}  // namespace
+
+void bench::run(int depth, int threads, int hash_mb) {
+    depth = std::max(depth, 1);
+    threads = std::max(threads, 1);
+    const size_t table_sz = std::max<size_t>(1, ((size_t) std::max(hash_mb, 1) << 20) / sizeof(ht::Entry));
+
+    std::vector<PositionResult> results(N_POSITIONS);
+    std::atomic<int> next_position(0);
+    utils::Timer timer;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (int i = next_position++; i < N_POSITIONS; i = next_position++) {
+                // a fresh table and search thread per position: the pawn, material and eval caches
+                // are thread_local, so a new thread starts with them empty and the node counts do
+                // not depend on which positions a worker searched before
+                auto table = std::make_unique<ht::Table>(table_sz);
+                thread::Thread searcher;
+                searcher.set_silent(true);
+                searcher.set_table(table.get());
+                Position pos = parse_position(POSITIONS[i]);
+                searcher.set_position(pos);
+                searcher.reset();
+                SearchLimit limit = {};
+                limit.depth = depth;
+                searcher.set_search_limit(limit);
+                searcher.start_search();
+                searcher.wait_for_search();
+                results[i] = PositionResult{pos, searcher.get_state().nodes, searcher.get_state().best_move};
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = timer.elapsed_millis();
+
+    // FNV-1a over the node counts and best moves, in position order
+    uint64_t signature = 0xcbf29ce484222325ULL;
+    unsigned long total_nodes = 0;
+    for (int i = 0; i < N_POSITIONS; i++) {
+        std::cout << "info string bench position " << i + 1 << "/" << N_POSITIONS << " nodes "
+                  << results[i].nodes << " bestmove " << notation::dump_uci_move(results[i].best_move, results[i].pos)
+                  << std::endl;
+        total_nodes += results[i].nodes;
+        for (uint64_t val : {(uint64_t) results[i].nodes, (uint64_t) results[i].best_move}) {
+            signature = (signature ^ val) * 0x100000001b3ULL;
+        }
+    }
+
+    std::cout << "===========================" << std::endl;
+    std::cout << "Total time (ms) : " << (unsigned long) elapsed << std::endl;
+    std::cout << "Nodes searched  : " << total_nodes << std::endl;
+    std::cout << "Nodes/second    : " << (unsigned long) (total_nodes * 1000. / std::max(elapsed, 1.)) << std::endl;
+    std::cout << "Signature       : " << std::hex << signature << std::dec << std::endl;
+}
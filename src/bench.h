@@ -0,0 +1,21 @@
+#pragma once
+/*
+ * Fixed-depth search benchmark: searches a fixed list of positions (the README's tricky
+ * positions and the perft suite) and prints the total nodes, time and nodes per second, plus a
+ * signature of the node counts. The signature changes with any change to the search, so it
+ * fingerprints the search functionally while the NPS tracks its speed.
+ *
+ * Every position is searched from scratch, with a fresh transposition table, so the node counts
+ * do not depend on the number of threads, which only search different positions concurrently.
+ */
+
+namespace bench {
+
+constexpr int DEFAULT_DEPTH = 5;
+constexpr int DEFAULT_THREADS = 1;
+// transposition table size per thread in MB
+constexpr int DEFAULT_HASH_MB = 16;
+
+void run(int depth, int threads, int hash_mb);
+
+}  // namespace bench
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 #include "bitboard.h"
 #include "utils.h"
@@ -13,15 +15,12 @@ const Bitboard REL_OCC_MASK = 0x7E7E7E7E7E7E00ULL;
 // magic bitboard database for bishops
 bboard::MagicInfo bboard::b_magics[64];
 bboard::MagicInfo bboard::r_magics[64];
-Bitboard bboard::b_attack_table[bboard::B_TABLE_SZ];  // the big attack table
-Bitboard bboard::r_attack_table[bboard::R_TABLE_SZ];
+Bitboard bboard::slider_attacks[bboard::SLIDER_ATTACKS_SZ];  // the big attack table
+uint16_t bboard::b_attack_refs[bboard::B_TABLE_SZ];
+uint16_t bboard::r_attack_refs[bboard::R_TABLE_SZ];
 Direction b_directions[]{NORTHWEST, NORTHEAST, SOUTHWEST, SOUTHEAST};
 Direction r_directions[]{NORTH, SOUTH, WEST, EAST};
 
-Bitboard bboard::p_attack_table[N_COLORS][64];
-Bitboard bboard::n_attack_table[64];
-Bitboard bboard::k_attack_table[64];
-
 // for bitscan
 const uint8_t bboard::debruijn_table[64] =
     {
@@ -36,6 +35,45 @@ const uint8_t bboard::debruijn_table[64] =
 
 const Bitboard bboard::DEBRUIJN = 0x022fdd63cc95386d;
 
+// magic numbers, so that startup does not need to search for them
+// generated by tools/gen_magics.cpp (make magics)
+const Bitboard B_MAGIC_NUMBERS[64] = {
+    0x00c420008c088882ULL, 0x0008580124012020ULL, 0x0004880200402040ULL, 0x00088a0201100280ULL,
+    0x0202021000082204ULL, 0x20108220202e0020ULL, 0x1080841009440a00ULL, 0x00110021010840c2ULL,
+    0x0400420821010204ULL, 0x0900020801110202ULL, 0x0200421089010200ULL, 0xc002022082001c08ULL,
+    0x20800110409a2080ULL, 0x000e020190082412ULL, 0x0110010442200444ULL, 0x0000890041104858ULL,
+    0x008400400408ba02ULL, 0x4490402004908082ULL, 0x0008001448010810ULL, 0x0118000382004442ULL,
+    0x1028200402080410ULL, 0x5202400808080421ULL, 0x1404800108086200ULL, 0x0204800202008258ULL,
+    0x0004201040c20400ULL, 0x0004510020221880ULL, 0x8200481010002144ULL, 0x0020080006081010ULL,
+    0x0404848044002000ULL, 0x2006008081482010ULL, 0x40010400c0443432ULL, 0x800a020800504600ULL,
+    0x0010040422200900ULL, 0x0008010481484808ULL, 0x0014020102208100ULL, 0x0010020080980081ULL,
+    0x0020044880040020ULL, 0x3020208080810808ULL, 0x9014280200009088ULL, 0x01409c0080204220ULL,
+    0x0080900421041004ULL, 0x010648020804108bULL, 0x0810901098041004ULL, 0x1810204010481200ULL,
+    0x0002280104000042ULL, 0x11a0200202100020ULL, 0x0010901121014442ULL, 0x0012008423020080ULL,
+    0x1080841009440a00ULL, 0x0409010101200000ULL, 0x0606084218440040ULL, 0x090c030020880001ULL,
+    0x0400000803040810ULL, 0x10402004d5820003ULL, 0x1040106410809088ULL, 0x0008580124012020ULL,
+    0x00110021010840c2ULL, 0x0000890041104858ULL, 0x8000000052009005ULL, 0x0081a04600209824ULL,
+    0x0880400120824414ULL, 0x0010802004040830ULL, 0x0400420821010204ULL, 0x00c420008c088882ULL,
+};
+const Bitboard R_MAGIC_NUMBERS[64] = {
+    0x0080104000208005ULL, 0x0040100040002000ULL, 0x1080088010002000ULL, 0x1080100080040802ULL,
+    0x1200081002002004ULL, 0x2300020400082100ULL, 0x0080010002000080ULL, 0xc080008010402100ULL,
+    0x3003800040038121ULL, 0x8242002090420104ULL, 0x0080801000802000ULL, 0x0001002010010009ULL,
+    0x0002000810060020ULL, 0x0006001008040200ULL, 0x0084001201108418ULL, 0x8242002090420104ULL,
+    0x0280004000402000ULL, 0x4010004040002000ULL, 0x0910008020008010ULL, 0x0180808010000803ULL,
+    0x2018808008000400ULL, 0x0000808002000400ULL, 0x9000040088320910ULL, 0x0004220001008044ULL,
+    0x000540048000a280ULL, 0x4010004040002000ULL, 0x0100900180200980ULL, 0x1d10080180300080ULL,
+    0x0100080080040082ULL, 0x2800040080020080ULL, 0x8001000100040200ULL, 0x90000102000c5084ULL,
+    0x0280004000402000ULL, 0x0000208101004000ULL, 0x0080801000802000ULL, 0x02100a2101001001ULL,
+    0x0008000400808008ULL, 0x0042010402000810ULL, 0x4800210804004250ULL, 0x0101010082000044ULL,
+    0x0008914000a18001ULL, 0x82600082c0028060ULL, 0x0910008020008010ULL, 0x8010040008004040ULL,
+    0x9102010804120020ULL, 0x920a008804620010ULL, 0x04c0010002008080ULL, 0x0d05000084430002ULL,
+    0x0001020040802a00ULL, 0x4c00200040100240ULL, 0x0600801000200880ULL, 0x0409003005e02900ULL,
+    0x0180800400080080ULL, 0x0006001008040200ULL, 0x0501820801900400ULL, 0x0021010400804200ULL,
+    0x0080048010244301ULL, 0x0003024000802013ULL, 0x200880120020400aULL, 0x0003001000052009ULL,
+    0x0082000820110402ULL, 0x4085000882440001ULL, 0x0031a12090480204ULL, 0x1009000142820ca1ULL,
+};
+
 /*
 Indexing:
 a1 corresponds to the LSB and h8 to the MSB. a2 is the second-LSB.
@@ -103,32 +141,64 @@ void r_init_occupancies() {
     }
 }
 
-/*
-Generate magics
- */
-void gen_magics(bboard::MagicInfo magics[], Bitboard table[],
-                Direction directions[]) {
+// Enumerate the subsets of each square's relevant occupancy along with their attacks, and call
+// fill(sq, offset, n_subsets, occupancy, reference), where offset is the start of the square's
+// slice in a table of all the squares' slices laid out one after another.
+template <typename Fill>
+void for_each_square_subsets(bboard::MagicInfo magics[], Direction directions[], Fill fill) {
     Bitboard reference[4096];  // 2^12, largest size of occ set of any square
     Bitboard occupancy[4096];
-    unsigned long long seed = 322;  // soft TODO find good seeds
-    int ord = 0;                    // ordinality; used as index for reference[]
+    size_t offset = 0;
     for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
         Bitboard rel_occupancy = magics[sq].occupancy_mask;
         // stores the current subset of occupancy
         Bitboard n = 0ULL;
         // iterate over subsets using the carry-rippler
         // https://www.chessprogramming.org/Traversing_Subsets_of_a_Set
-
-        // ord is the size of the table for the previous square
-        magics[sq].table = (sq == SQ_A1) ? table : (magics[sq - 1].table + ord);
-        ord = 0;
+        int ord = 0;  // ordinality; used as index for reference[]
         do {
-            // TODO attack reference in as a temp local var
             reference[ord] = sliding_attacks(sq, n, directions);
             occupancy[ord] = n;
             ord++;
             n = (n - rel_occupancy) & rel_occupancy;
         } while (n != 0ULL);
+        fill(sq, offset, ord, occupancy, reference);
+        offset += ord;
+    }
+}
+
+/*
+Fill the index tables, indexed by the magics already in magics[] (or by PEXT with USE_PEXT), with
+the index of each attack set in slider_attacks. Attack sets already in slider_attacks, e.g. from
+another square, are shared; attack_ids maps each one to its index.
+ */
+void fill_attack_refs(bboard::MagicInfo magics[], uint16_t refs[], Direction directions[],
+                      std::unordered_map<Bitboard, uint16_t>& attack_ids) {
+    for_each_square_subsets(magics, directions, [&](Square sq, size_t offset, int ord,
+                                                    const Bitboard occupancy[], const Bitboard reference[]) {
+        magics[sq].refs = refs + offset;
+        for (int i = 0; i < ord; i++) {
+            auto it = attack_ids.find(reference[i]);
+            if (it == attack_ids.end()) {
+                assert(attack_ids.size() < (size_t) bboard::SLIDER_ATTACKS_SZ);
+                it = attack_ids.emplace(reference[i], (uint16_t) attack_ids.size()).first;
+                bboard::slider_attacks[it->second] = reference[i];
+            }
+            magics[sq].refs[magics[sq].get_index(occupancy[i])] = it->second;
+        }
+    });
+}
+
+/*
+Search for magics by trial and error, using table as scratch space. The index is computed
+explicitly rather than by get_index() so that this works in USE_PEXT builds too.
+ */
+void search_magics(bboard::MagicInfo magics[], Bitboard table[], Direction directions[]) {
+    unsigned long long seed = 322;  // soft TODO find good seeds
+    for_each_square_subsets(magics, directions, [&](Square sq, size_t offset, int ord,
+                                                    const Bitboard occupancy[], const Bitboard reference[]) {
+        Bitboard* slice = table + offset;
+        Bitboard rel_occupancy = magics[sq].occupancy_mask;
         utils::PRNG prng(seed);
         bool good = true;
         // try 100 million times
@@ -138,7 +208,6 @@ void gen_magics(bboard::MagicInfo magics[], Bitboard table[],
             if (utils::popcount((magics[sq].magic * rel_occupancy) >> 56) < 6)
                 continue;
 
-            int collisions = 0;  // count of acceptable (good) collisions
             /*
             TODO implement later
             there is a speed-up trick here by sacrificing space:
@@ -152,28 +221,21 @@ void gen_magics(bboard::MagicInfo magics[], Bitboard table[],
             Note that the size of this array could be statically allocated to be
             4096, the largest possible table size for a square, or dynamically
             allocated to have size = ord
-
-            Also TODO optimize for PEXT simd instructions where
-            index = pext(occupancy_mask, occupancy)
             */
-            std::fill_n(magics[sq].table, ord, 0ULL);
+            std::fill_n(slice, ord, 0ULL);
             good = true;
             for (int i = 0; i < ord; i++) {
                 // note index <= ord because ord = 2 ** (64 - shifts) and
                 // index is shifted to have at most (64 - shifts) nonzero bits
-                int index = magics[sq].get_index(occupancy[i]);
-                if (magics[sq].table[index] == 0ULL) {
+                unsigned int index = (unsigned int)((occupancy[i] * magics[sq].magic) >> magics[sq].shift);
+                if (slice[index] == 0ULL) {
                     // unoccupied
-                    magics[sq].table[index] = reference[i];
-                } else {
-                    if (magics[sq].table[index] != reference[i]) {
-                        // bad collision
-                        good = false;
-                        break;
-                    } else {  // otherwise, good collision
-                        collisions++;
-                    }
-                }
+                    slice[index] = reference[i];
+                } else if (slice[index] != reference[i]) {
+                    // bad collision
+                    good = false;
+                    break;
+                }  // otherwise, good collision
             }
             if (good) {
                 break;
@@ -182,7 +244,7 @@ void gen_magics(bboard::MagicInfo magics[], Bitboard table[],
         if (!good) {
             LOG(logERROR) << "magic not found";
         }
-    }
+    });
 }
 
 #if 0
@@ -200,107 +262,36 @@ Bitboard from_str(string repr) {
 }
 #endif
 
-void init_magic(void) {
+void init_occupancies(void) {
     b_init_occupancies();
     r_init_occupancies();
-
-    gen_magics(bboard::b_magics, bboard::b_attack_table, b_directions);
-    gen_magics(bboard::r_magics, bboard::r_attack_table, r_directions);
 }
+}  // namespace
 
-// initialize attack tables for pawns, knights, and kings
-void init_attack_tables(void) {
-    Bitboard mask;
-    Square t_sq;
-    Color colors[]{WHITE, BLACK};
-
-    // pawns
-    for (Color c : colors) {
-        int d_rank = c == WHITE ? 1 : -1;
-        // actually we can omit the last row for each color since a pawn cannot
-        // possibly be there, but that doesn't make a huge difference
-        for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
-            mask = 0ULL;
-
-            t_sq = sq;
-            if (utils::move_square(t_sq, d_rank, -1)) {
-                mask |= bboard::mask_square(t_sq);
-            }
-
-            t_sq = sq;
-            if (utils::move_square(t_sq, d_rank, 1)) {
-                mask |= bboard::mask_square(t_sq);
-            }
-
-            bboard::p_attack_table[(int)c][sq] = mask;
-        }
-    }
-
-    // // pawn first pushes (2 squares)
-    // for (Square sq = SQ_A2; sq <= SQ_H2; sq++) {
-    //     // move two ranks up
-    //     bboard::p_push_table[(int)WHITE][sq] |= bboard::mask_square(to_square(sq + 16));
-    // }
-
-    // for (Square sq = SQ_A7; sq <= SQ_H7; sq++) {
-    //     // move two ranks down
-    //     bboard::p_push_table[(int)BLACK][sq] |= bboard::mask_square(to_square(sq - 16));
-    // }
-
-    // knights
+void bboard::initialize() {
+    init_occupancies();
     for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
-        mask = 0ULL;
-        for (int d_rank = -1; d_rank <= 1; d_rank += 2) {
-            for (int d_file = -2; d_file <= 2; d_file += 4) {
-                t_sq = sq;
-                if (utils::move_square(t_sq, d_rank, d_file)) {
-                    mask |= bboard::mask_square(t_sq);
-                }
-            }
-        }
-
-        for (int d_file = -1; d_file <= 1; d_file += 2) {
-            for (int d_rank = -2; d_rank <= 2; d_rank += 4) {
-                t_sq = sq;
-                if (utils::move_square(t_sq, d_rank, d_file)) {
-                    mask |= bboard::mask_square(t_sq);
-                }
-            }
-        }
-
-        bboard::n_attack_table[sq] = mask;
+        bboard::b_magics[sq].magic = B_MAGIC_NUMBERS[sq];
+        bboard::r_magics[sq].magic = R_MAGIC_NUMBERS[sq];
     }
+    std::unordered_map<Bitboard, uint16_t> attack_ids;
+    fill_attack_refs(bboard::b_magics, bboard::b_attack_refs, b_directions, attack_ids);
+    fill_attack_refs(bboard::r_magics, bboard::r_attack_refs, r_directions, attack_ids);
+    assert(attack_ids.size() == (size_t) bboard::SLIDER_ATTACKS_SZ);
+}
 
-    // kings
+void bboard::search_magics(Bitboard out_b_magics[64], Bitboard out_r_magics[64]) {
+    init_occupancies();
+    std::vector<Bitboard> scratch(std::max(B_TABLE_SZ, R_TABLE_SZ));
+    ::search_magics(bboard::b_magics, scratch.data(), b_directions);
+    ::search_magics(bboard::r_magics, scratch.data(), r_directions);
     for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
-        mask = 0ULL;
-        for (int d_rank = -1; d_rank <= 1; d_rank++) {
-            for (int d_file = -1; d_file <= 1; d_file++) {
-                t_sq = sq;
-                if (utils::move_square(t_sq, d_rank, d_file)) {
-                    mask |= bboard::mask_square(t_sq);
-                }
-            }
-        }
-
-        mask &= ~bboard::mask_square(sq);  // unset bit at offset (0, 0)
-
-        bboard::k_attack_table[sq] = mask;
+        out_b_magics[sq] = bboard::b_magics[sq].magic;
+        out_r_magics[sq] = bboard::r_magics[sq].magic;
     }
-}
-}  // namespace
-
-void bboard::initialize() {
-    LOG(logDEBUG) << "Initializing magics...";
-    init_magic();
-    LOG(logDEBUG) << "Done.";
-    LOG(logDEBUG) << "Initializing other attacks...";
-    init_attack_tables();
-    LOG(logDEBUG) << "Done.";
-}
-
-unsigned int bboard::MagicInfo::get_index(Bitboard occupancy) {
-    return (unsigned int)(((occupancy & occupancy_mask) * magic) >> shift);
+    std::unordered_map<Bitboard, uint16_t> attack_ids;
+    fill_attack_refs(bboard::b_magics, bboard::b_attack_refs, b_directions, attack_ids);
+    fill_attack_refs(bboard::r_magics, bboard::r_attack_refs, r_directions, attack_ids);
 }
 
 void test_magics() {
@@ -1,22 +1,38 @@
 #pragma once
 
+#include <array>
 #include <string>
 
+#ifdef USE_PEXT
+#include <immintrin.h>
+#endif
+
 #include "types.h"
 #include "utils.h"
 
 namespace bboard {
 
+// With USE_PEXT (make ARCH=bmi2 or avx2), the index is the relevant occupancy bits extracted with PEXT
+// and magic and shift are unused.
 struct MagicInfo {
     Bitboard magic;           // magic that multiplies the key to get the index
     Bitboard occupancy_mask;  // relevant occupancy masks
     Bitboard shift;           // number of shifts applied to index
-    Bitboard *table;          // pointer to the move/atk table for this square
-    unsigned int get_index(Bitboard occupancy);
+    uint16_t *refs;           // this square's slice of the index into slider_attacks
+
+    inline unsigned int get_index(Bitboard occupancy) const {
+#ifdef USE_PEXT
+        return (unsigned int)_pext_u64(occupancy, occupancy_mask);
+#else
+        return (unsigned int)(((occupancy & occupancy_mask) * magic) >> shift);
+#endif
+    }
 };
 
 constexpr int B_TABLE_SZ = 5248;
 constexpr int R_TABLE_SZ = 102400;
+// number of distinct bishop and rook attack sets over all squares and occupancies
+constexpr int SLIDER_ATTACKS_SZ = 6326;
 
 // for bitscan
 const extern uint8_t debruijn_table[64];
@@ -25,42 +41,99 @@ const extern Bitboard DEBRUIJN;
 // magic bitboard database for bishops
 extern MagicInfo b_magics[64];
 extern MagicInfo r_magics[64];
-extern Bitboard b_attack_table[B_TABLE_SZ];  // the big attack table
-extern Bitboard r_attack_table[R_TABLE_SZ];
-extern Bitboard p_attack_table[N_COLORS][64];
-extern Bitboard n_attack_table[64];
-extern Bitboard k_attack_table[64];
-
-// occupancy that must not be attacked for castling to be possible.
-// NOTE does not include king's own square.
-// Indexing: white kingside, white queenside, black kingside, black queenside.
-static Bitboard castle_king_occ_table[]{0x60ULL, 0xcULL, 0x6000000000000000ULL,
-                                   0xc00000000000000ULL};
-
-// occupancy that must not be occupied for castling to be possible (i.e.
-// squares between king and rook
-static Bitboard castle_between_occ_table[]{0x60ULL, 0xeULL, 0x6000000000000000ULL,
-                                   0xe00000000000000ULL};
-
-// called once at the start of the program; populate move tables
+// Slider attacks are stored once in slider_attacks, shared by all squares of both piece types.
+// A magic index selects an entry of the square's slice of b_attack_refs or r_attack_refs, which
+// holds the index of the attack set in slider_attacks. This is about a third of the size of one
+// attack set per magic index.
+extern Bitboard slider_attacks[SLIDER_ATTACKS_SZ];
+extern uint16_t b_attack_refs[B_TABLE_SZ];
+extern uint16_t r_attack_refs[R_TABLE_SZ];
+
+// attacks from sq of a piece that jumps by each of the (rank, file) offsets
+constexpr Bitboard leaper_attacks(int sq, const int offsets[][2], int n_offsets) {
+    Bitboard mask = 0ULL;
+    for (int i = 0; i < n_offsets; i++) {
+        int rank = sq / 8 + offsets[i][0];
+        int file = sq % 8 + offsets[i][1];
+        if (rank >= 0 && rank < 8 && file >= 0 && file < 8) {
+            mask |= 1ULL << (rank * 8 + file);
+        }
+    }
+    return mask;
+}
+
+constexpr std::array<Bitboard, 64> leaper_table(const int offsets[][2], int n_offsets) {
+    std::array<Bitboard, 64> table{};
+    for (int sq = 0; sq < 64; sq++) {
+        table[sq] = leaper_attacks(sq, offsets, n_offsets);
+    }
+    return table;
+}
+
+constexpr int W_PAWN_OFFSETS[2][2]{{1, -1}, {1, 1}};
+constexpr int B_PAWN_OFFSETS[2][2]{{-1, -1}, {-1, 1}};
+constexpr int KNIGHT_OFFSETS[8][2]{{1, 2}, {1, -2}, {-1, 2}, {-1, -2}, {2, 1}, {2, -1}, {-2, 1}, {-2, -1}};
+constexpr int KING_OFFSETS[8][2]{{1, 1}, {1, 0}, {1, -1}, {0, 1}, {0, -1}, {-1, 1}, {-1, 0}, {-1, -1}};
+
+// leaper attack tables, computed at compile time
+inline constexpr std::array<std::array<Bitboard, 64>, N_COLORS> p_attack_table{
+    leaper_table(W_PAWN_OFFSETS, 2), leaper_table(B_PAWN_OFFSETS, 2)};
+inline constexpr std::array<Bitboard, 64> n_attack_table = leaper_table(KNIGHT_OFFSETS, 8);
+inline constexpr std::array<Bitboard, 64> k_attack_table = leaper_table(KING_OFFSETS, 8);
+
+// called once at the start of the program; populate the slider attack tables from the
+// precomputed magics
 void initialize();
 
+// search for the bishop and rook magics from scratch and also populate the slider attack tables
+// with them; used by tools/gen_magics.cpp to regenerate the precomputed magics
+void search_magics(Bitboard out_b_magics[64], Bitboard out_r_magics[64]);
+
 std::string repr(Bitboard bitboard);
 
 inline Bitboard mask_square(const Square& square) {
     return 1ULL << square;
 }
 
-// return the index of the least significant set bit
+// mask of all squares on a file (0 = a-file) or rank (0 = first rank)
+inline Bitboard file_mask(int file) {
+    return 0x0101010101010101ULL << file;
+}
+
+inline Bitboard rank_mask(int rank) {
+    return RANK_A << (8 * rank);
+}
+
+// files directly to the left and right of the given file
+inline Bitboard adjacent_files_mask(int file) {
+    return (file > 0 ? file_mask(file - 1) : 0ULL) |
+           (file < 7 ? file_mask(file + 1) : 0ULL);
+}
+
+// all squares on ranks strictly in front of sq, from c's point of view
+inline Bitboard forward_ranks_mask(Color c, Square sq) {
+    int rank = utils::sq_rank(sq);
+    if (c == WHITE) {
+        return rank == 7 ? 0ULL : ~0ULL << (8 * (rank + 1));
+    }
+    return rank == 0 ? 0ULL : ~0ULL >> (8 * (8 - rank));
+}
+
+// return the index of the least significant set bit; board must not be empty
 inline Square bitscan_fwd(Bitboard board) {
+#if defined(__BMI__)
+    // a single TZCNT instruction
+    return utils::to_square(__builtin_ctzll(board));
+#else
     return utils::to_square(
         debruijn_table[((board & -board) * DEBRUIJN) >> 58]);
+#endif
 }
 
 // same as bitscan_fwd but unsets the found bit
 inline Square bitscan_fwd_remove(Bitboard& board) {
     Square sq = bitscan_fwd(board);
-    board &= ~bboard::mask_square(sq);
+    board &= board - 1;  // unset the least significant bit
     return sq;
 }
 
@@ -70,11 +143,11 @@ inline bool one_bit(Bitboard board) {
 }
 
 inline Bitboard bishop_attacks(Square sq, Bitboard occ) {
-    return b_magics[sq].table[b_magics[sq].get_index(occ)];
+    return slider_attacks[b_magics[sq].refs[b_magics[sq].get_index(occ)]];
 }
 
 inline Bitboard rook_attacks(Square sq, Bitboard occ) {
-    return r_magics[sq].table[r_magics[sq].get_index(occ)];
+    return slider_attacks[r_magics[sq].refs[r_magics[sq].get_index(occ)]];
 }
 
 inline Bitboard queen_attacks(Square sq, Bitboard occ) {
@@ -95,14 +168,6 @@ inline Bitboard knight_attacks(Square sq) { return n_attack_table[sq]; }
 
 inline Bitboard king_attacks(Square sq) { return k_attack_table[sq]; }
 
-inline Bitboard castle_king_occ(Color c, BoardSide side) {
-    return castle_king_occ_table[static_cast<int>(c) * 2 + static_cast<int>(side)];
-}
-
-inline Bitboard castle_between_occ(Color c, BoardSide side) {
-    return castle_between_occ_table[static_cast<int>(c) * 2 + static_cast<int>(side)];
-}
-
 // Find the first occupied square from s1 to s2.
 Bitboard blocker(Square s1, Square s2, Bitboard occ);
 
@@ -0,0 +1,35 @@
+#pragma once
+/*
+ * Polyglot opening books.
+ *
+ * A book is a file of 16-byte big-endian entries sorted by key: the Polyglot hash of a position
+ * (8 bytes), a move (2 bytes), a weight (2 bytes) and learning data (4 bytes, unused). Moves are
+ * the to square (bits 0-5), the from square (bits 6-11) and the promotion piece (bits 12-14:
+ * none, knight, bishop, rook, queen); castling is encoded as the king capturing its rook, e.g.
+ * e1h1. The file is memory mapped and binary searched.
+ *
+ * The Polyglot hash is independent of the zobrist keys: it XORs 781 random numbers for the
+ * pieces, the castling rights, the en-passant file (only if a pawn can capture en passant) and
+ * white to move. The random numbers are the standard Random64 table, so books made by other
+ * tools (e.g. polyglot make-book) can be used; the starting position hashes to
+ * 0x463B96181691FC9C.
+ */
+
+#include <string>
+
+#include "types.h"
+#include "position.h"
+
+namespace book {
+
+// Map the book at path, closing any previous book. An empty path or "<empty>" closes the book.
+// Return whether a book is open.
+bool open(const std::string& path);
+
+ZobristKey polyglot_key(const Position& pos);
+
+// Return a legal book move for pos, chosen at random in proportion to the entries' weights, or
+// NULL_MOVE if there is none (or no book).
+Move probe(const Position& pos);
+
+}  // namespace book
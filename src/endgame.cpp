@@ -0,0 +1,258 @@
+#include "endgame.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bitboard.h"
+#include "evaluate.h"
+#include "hash.h"
+#include "utils.h"
+
+namespace {
+
+/*
+KPK bitbase, adapted from Stockfish's bitbase.cpp: one bit per position with white to move or
+black to move, white king, black king, and the pawn on files a-d and ranks 2-7, set if white wins.
+2 * 24 * 64 * 64 bits = 24KB.
+*/
+constexpr unsigned KPK_SIZE = 2 * 24 * 64 * 64;
+uint32_t kpk_bitbase[KPK_SIZE / 32];
+
+// stm: 0 for white, 1 for black
+inline unsigned kpk_index(unsigned stm, Square bksq, Square wksq, Square psq) {
+    return wksq | (bksq << 6) | (stm << 12) | (utils::sq_file(psq) << 13) |
+           ((6 - utils::sq_rank(psq)) << 15);
+}
+
+enum KPKResult : uint8_t { KPK_INVALID = 0, KPK_UNKNOWN = 1, KPK_DRAW = 2, KPK_WIN = 4 };
+
+inline int distance(Square a, Square b) {
+    return std::max(std::abs(utils::sq_rank(a) - utils::sq_rank(b)),
+                    std::abs(utils::sq_file(a) - utils::sq_file(b)));
+}
+
+struct KPKPosition {
+    unsigned stm;
+    Square ksq[N_COLORS];
+    Square psq;
+    KPKResult result;
+
+    explicit KPKPosition(unsigned idx) {
+        ksq[WHITE] = Square(idx & 0x3F);
+        ksq[BLACK] = Square((idx >> 6) & 0x3F);
+        stm = (idx >> 12) & 1;
+        psq = utils::make_square(6 - ((idx >> 15) & 7), (idx >> 13) & 3);
+        Square push = Square(psq + 8);
+
+        if (distance(ksq[WHITE], ksq[BLACK]) <= 1 || ksq[WHITE] == psq || ksq[BLACK] == psq ||
+            (stm == WHITE && (bboard::pawn_attacks(psq, WHITE) & bboard::mask_square(ksq[BLACK])))) {
+            // kings touching, overlapping pieces, or the black king can be captured
+            result = KPK_INVALID;
+        } else if (stm == WHITE && utils::sq_rank(psq) == 6 && ksq[WHITE] != push && ksq[BLACK] != push &&
+                   (distance(ksq[BLACK], push) > 1 ||
+                    (bboard::king_attacks(ksq[WHITE]) & bboard::mask_square(push)))) {
+            // the pawn promotes without being captured
+            result = KPK_WIN;
+        } else if (stm == BLACK &&
+                   (!(bboard::king_attacks(ksq[BLACK]) &
+                      ~(bboard::king_attacks(ksq[WHITE]) | bboard::pawn_attacks(psq, WHITE))) ||
+                    (bboard::king_attacks(ksq[BLACK]) & bboard::mask_square(psq) &
+                     ~bboard::king_attacks(ksq[WHITE])))) {
+            // stalemate, or the black king captures the undefended pawn
+            result = KPK_DRAW;
+        } else {
+            result = KPK_UNKNOWN;
+        }
+    }
+
+    // classify by the results of the positions after each move, as far as they are known
+    KPKResult classify(const std::vector<KPKPosition>& db) const {
+        const KPKResult good = stm == WHITE ? KPK_WIN : KPK_DRAW;
+        const KPKResult bad = stm == WHITE ? KPK_DRAW : KPK_WIN;
+
+        unsigned r = KPK_INVALID;
+        Bitboard moves = bboard::king_attacks(ksq[stm]);
+        while (moves) {
+            Square to = bboard::bitscan_fwd_remove(moves);
+            r |= stm == WHITE ? db[kpk_index(BLACK, ksq[BLACK], to, psq)].result
+                              : db[kpk_index(WHITE, to, ksq[WHITE], psq)].result;
+        }
+
+        if (stm == WHITE) {
+            Square push = Square(psq + 8);
+            if (utils::sq_rank(psq) < 6) {
+                r |= db[kpk_index(BLACK, ksq[BLACK], ksq[WHITE], push)].result;
+            }
+            if (utils::sq_rank(psq) == 1 && push != ksq[WHITE] && push != ksq[BLACK]) {
+                r |= db[kpk_index(BLACK, ksq[BLACK], ksq[WHITE], Square(push + 8))].result;
+            }
+        }
+
+        return (r & good) ? good : (r & KPK_UNKNOWN) ? KPK_UNKNOWN : bad;
+    }
+};
+
+void init_kpk() {
+    std::vector<KPKPosition> db;
+    db.reserve(KPK_SIZE);
+    for (unsigned idx = 0; idx < KPK_SIZE; idx++) {
+        db.emplace_back(idx);
+    }
+
+    // retrograde iteration until no unknown position can be classified any more
+    bool repeat = true;
+    while (repeat) {
+        repeat = false;
+        for (KPKPosition& kpk : db) {
+            if (kpk.result == KPK_UNKNOWN) {
+                kpk.result = kpk.classify(db);
+                repeat |= kpk.result != KPK_UNKNOWN;
+            }
+        }
+    }
+
+    std::memset(kpk_bitbase, 0, sizeof(kpk_bitbase));
+    for (unsigned idx = 0; idx < KPK_SIZE; idx++) {
+        if (db[idx].result == KPK_WIN) {
+            kpk_bitbase[idx / 32] |= 1u << (idx % 32);
+        }
+    }
+}
+
+/* helpers to drive the weak king */
+
+// larger the closer sq is to the edge of the board, 0 to 90
+inline int push_to_edge(Square sq) {
+    int rank_dist = std::min(utils::sq_rank(sq), 7 - utils::sq_rank(sq));
+    int file_dist = std::min(utils::sq_file(sq), 7 - utils::sq_file(sq));
+    return 90 - (7 * file_dist * file_dist / 2 + 7 * rank_dist * rank_dist / 2);
+}
+
+// larger the closer the two squares are, 0 to 120
+inline int push_close(Square a, Square b) {
+    return 140 - 20 * distance(a, b);
+}
+
+// larger the closer sq is to a1 or h8, 0 to 7
+inline int push_to_dark_corner(Square sq) {
+    return std::abs(7 - utils::sq_rank(sq) - utils::sq_file(sq));
+}
+
+inline Square king_square(const Position& pos, Color c) {
+    return bboard::bitscan_fwd(pos.get_bitboard(c, KING));
+}
+
+// KRK and KQK: drive the weak king to the edge and bring the strong king closer
+Score eval_kxk(const Position& pos, Color strong) {
+    Color weak = utils::opposite_color(strong);
+    Square strong_king = king_square(pos, strong);
+    Square weak_king = king_square(pos, weak);
+    Score material = 0;
+    for (PieceType pt = PAWN; pt < KING; pt = (PieceType) (pt + 1)) {
+        material += eg_value[pt] * utils::popcount(pos.get_bitboard(strong, pt));
+    }
+    return endgame::KNOWN_WIN + material + push_to_edge(weak_king) + push_close(strong_king, weak_king);
+}
+
+// KBNK: mate can only be forced in a corner of the bishop's color
+Score eval_kbnk(const Position& pos, Color strong) {
+    Color weak = utils::opposite_color(strong);
+    Square strong_king = king_square(pos, strong);
+    Square weak_king = king_square(pos, weak);
+    bool dark_bishop = pos.get_bitboard(strong, BISHOP) & DARK_SQUARES;
+    if (!dark_bishop) {
+        // mirror horizontally so that the light corners a8 and h1 become a1 and h8
+        weak_king = Square(weak_king ^ 7);
+    }
+    return endgame::KNOWN_WIN + eg_value[KNIGHT] + eg_value[BISHOP] + 3 * push_close(strong_king, weak_king) +
+           40 * push_to_dark_corner(weak_king);
+}
+
+// KPK: exact win/draw from the bitbase
+Score eval_kpk(const Position& pos, Color strong) {
+    Color weak = utils::opposite_color(strong);
+    Square strong_king = king_square(pos, strong);
+    Square weak_king = king_square(pos, weak);
+    Square pawn = bboard::bitscan_fwd(pos.get_bitboard(strong, PAWN));
+    if (strong == BLACK) {
+        strong_king = utils::flip(strong_king);
+        weak_king = utils::flip(weak_king);
+        pawn = utils::flip(pawn);
+    }
+    if (!endgame::probe_kpk(strong_king, pawn, weak_king, pos.get_side_to_move() == strong)) {
+        return SCORE_DRAW;
+    }
+    return endgame::KNOWN_WIN + eg_value[PAWN] + 10 * utils::sq_rank(pawn);
+}
+
+// KNNK: two knights cannot force mate
+Score eval_draw(const Position&, Color) {
+    return SCORE_DRAW;
+}
+
+const endgame::Evaluator EVALUATORS[] = {
+    {"KPK", eval_kpk},
+    {"KBNK", eval_kbnk},
+    {"KRK", eval_kxk},
+    {"KQK", eval_kxk},
+    {"KNNK", eval_draw},
+};
+
+struct RegistryEntry {
+    const endgame::Evaluator* evaluator;
+    Color strong;
+};
+
+std::unordered_map<ZobristKey, RegistryEntry> registry;
+
+// material hash key of the configuration given by code with strong as the side of the first king
+ZobristKey material_key(const char* code, Color strong) {
+    static const std::string PIECES = "PNBRQK";
+    ZobristKey key = 0;
+    int counts[N_COLORS][N_REAL_PIECE_TYPES] = {};
+    // the second 'K' starts the weak side
+    Color c = utils::opposite_color(strong);
+    for (const char* p = code; *p; p++) {
+        if (*p == 'K') {
+            c = utils::opposite_color(c);
+        }
+        PieceType pt = (PieceType) PIECES.find(*p);
+        key ^= zobrist::get_material_key(c, pt, counts[c][pt]++);
+    }
+    return key;
+}
+}  // namespace
+
+void endgame::initialize() {
+    init_kpk();
+    registry.clear();
+    for (const Evaluator& evaluator : EVALUATORS) {
+        for (Color strong : {WHITE, BLACK}) {
+            registry[material_key(evaluator.code, strong)] = RegistryEntry{&evaluator, strong};
+        }
+    }
+}
+
+const endgame::Evaluator* endgame::find_evaluator(ZobristKey material_key, Color& strong) {
+    auto it = registry.find(material_key);
+    if (it == registry.end()) {
+        return nullptr;
+    }
+    strong = it->second.strong;
+    return it->second.evaluator;
+}
+
+bool endgame::probe_kpk(Square strong_king, Square pawn, Square weak_king, bool strong_to_move) {
+    // the bitbase only has the pawn on files a-d
+    if (utils::sq_file(pawn) >= 4) {
+        strong_king = Square(strong_king ^ 7);
+        weak_king = Square(weak_king ^ 7);
+        pawn = Square(pawn ^ 7);
+    }
+    unsigned idx = kpk_index(strong_to_move ? WHITE : BLACK, weak_king, strong_king, pawn);
+    return kpk_bitbase[idx / 32] & (1u << (idx % 32));
+}
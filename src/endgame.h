@@ -0,0 +1,40 @@
+#pragma once
+/*
+ * Specialized endgame evaluation: a KPK bitbase and a registry of evaluators for material
+ * configurations that the general evaluation plays badly (KBNK, KRK, KQK, KPK, KNNK). The material
+ * table looks up the evaluator of each material configuration once (see material::Entry).
+ */
+
+#include "types.h"
+#include "position.h"
+
+namespace endgame {
+
+// scores of won endgames are offset by this, so that the search prefers converting to them
+constexpr Score KNOWN_WIN = 10000;
+
+// endgame scale factors, out of SCALE_NORMAL
+constexpr int SCALE_NORMAL = 64;
+constexpr int SCALE_DRAW = 0;
+
+// evaluate pos from the strong side's point of view
+using EvalFn = Score (*)(const Position& pos, Color strong);
+
+struct Evaluator {
+    // material of the strong side followed by the weak side, e.g. "KBNK"
+    const char* code;
+    EvalFn fn;
+};
+
+// Build the KPK bitbase and the evaluator registry. Must be called after zobrist::initialize().
+void initialize();
+
+// Return the evaluator for the material hash key, or nullptr if there is none. Sets strong to
+// the side with the extra material.
+const Evaluator* find_evaluator(ZobristKey material_key, Color& strong);
+
+// Whether the side with the pawn wins KPK. Squares are given from the strong side's point of
+// view, i.e. as if the strong side were white.
+bool probe_kpk(Square strong_king, Square pawn, Square weak_king, bool strong_to_move);
+
+}  // namespace endgame
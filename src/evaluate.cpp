@@ -1,8 +1,22 @@
 #include <stdlib.h>  // rand
+#include <algorithm>
 #include <cassert>
+#include <iomanip>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "evaluate.h"
+#include "endgame.h"
+#include "hash.h"
+#include "material.h"
 #include "movegen.h"
+#include "nnue.h"
+#include "pawns.h"
 #include "utils.h"
 
 
@@ -168,6 +182,12 @@ int gamephaseInc[12] = {0,0,1,1,1,1,2,2,4,4,0,0};
 int mg_table[12][64];
 int eg_table[12][64];
 
+// mg_table and eg_table with black's values negated, for summing white - black in one pass.
+// Indexed by [piece and color index][square]; the last slot is all zeros, for padding.
+constexpr int PSQT_ZERO_SLOT = 12;
+alignas(32) int32_t psqt_mg[13][64];
+alignas(32) int32_t psqt_eg[13][64];
+
 void init_eval_tables()
 {
     for (PieceType piece = PAWN; piece <= KING; piece = (PieceType) (piece + 1)) {
@@ -177,6 +197,10 @@ void init_eval_tables()
             eg_table[pc]  [sq] = eg_value[piece] + eg_pesto_table[piece][sq];
             mg_table[pc+1][sq] = mg_value[piece] + mg_pesto_table[piece][utils::flip(sq)];
             eg_table[pc+1][sq] = eg_value[piece] + eg_pesto_table[piece][utils::flip(sq)];
+            psqt_mg[pc]  [sq] = mg_table[pc][sq];
+            psqt_eg[pc]  [sq] = eg_table[pc][sq];
+            psqt_mg[pc+1][sq] = -mg_table[pc+1][sq];
+            psqt_eg[pc+1][sq] = -eg_table[pc+1][sq];
         }
     }
 }
@@ -190,8 +214,7 @@ Score mobility(Color c, const Position& pos) {
     Bitboard def_half = c == WHITE ? WHITE_HALF : BLACK_HALF;
     Score mob = 0;
 
-    Bitboard pinner = 0ULL;
-    Bitboard pinned = absolute_pins(pos, c, pinner);
+    Bitboard pinned = pos.get_pinned(c);
 
     Bitboard free_knights = pos.get_bitboard(c, KNIGHT) & ~pinned;
     while (free_knights != 0ULL) {
@@ -235,7 +258,9 @@ Score mobility(Color c, const Position& pos) {
     return mob;
 }
 
-Score evaluate(const Position& pos) {
+namespace {
+template <bool Trace>
+Score classical_eval_impl(const Position& pos, EvalTrace* trace) {
     Score ret = 0.;
     Score color_multiplier = utils::color_multiplier(pos.get_side_to_move());
 
@@ -249,11 +274,21 @@ Score evaluate(const Position& pos) {
         int wcount = utils::popcount(pb & pos.get_color_bitboard(WHITE));
         int bcount = utils::popcount(pb & pos.get_color_bitboard(BLACK));
         ret += MATERIAL_SCORES[piece] * (wcount - bcount);
+        if constexpr (Trace) {
+            trace->mg[TERM_MATERIAL][WHITE] += MATERIAL_SCORES[piece] * wcount;
+            trace->mg[TERM_MATERIAL][BLACK] += MATERIAL_SCORES[piece] * bcount;
+        }
     }
 
 #ifndef MAT_ONLY
     // Add mobility
-    ret += mobility_weight * (mobility(WHITE, pos) - mobility(BLACK, pos));
+    Score white_mobility = mobility_weight * mobility(WHITE, pos);
+    Score black_mobility = mobility_weight * mobility(BLACK, pos);
+    ret += white_mobility - black_mobility;
+    if constexpr (Trace) {
+        trace->mg[TERM_MOBILITY][WHITE] = white_mobility;
+        trace->mg[TERM_MOBILITY][BLACK] = black_mobility;
+    }
 #endif
 
     Score value_score = ret * color_multiplier;
@@ -262,20 +297,268 @@ Score evaluate(const Position& pos) {
     // Add small penalty if in check
     if (pos.is_checking()) {
         value_score -= checked_penalty;
+        if constexpr (Trace) {
+            trace->mg[TERM_CHECK][pos.get_side_to_move()] = -checked_penalty;
+        }
     }
 #endif
 
+    if constexpr (Trace) {
+        // no tapering
+        trace->phase = 24;
+        trace->eg_scale = endgame::SCALE_NORMAL;
+        trace->total = value_score;
+    }
     return value_score;
 }
+}  // namespace
+
+Score classical_eval(const Position& pos) {
+    return classical_eval_impl<false>(pos, nullptr);
+}
+
+Score trace_eval(const Position& pos, EvalTrace& trace) {
+    trace = EvalTrace{};
+    return classical_eval_impl<true>(pos, &trace);
+}
+
+void evaluate_batch(const Position* positions, Score* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = compute_eval(positions[i]);
+    }
+}
 #else
 
 /* Attribution: PeSTO's Evaluation Function based on Pawel Koziol's implementation in TSCP by Tom Kerrigan */
 
-Score evaluate(const Position& pos)
+namespace {
+
+/* mobility: bonus per safe square attacked beyond a typical count, by piece type */
+constexpr int MOBILITY_MG[N_REAL_PIECE_TYPES] = {0, 4, 5, 2, 1, 0};
+constexpr int MOBILITY_EG[N_REAL_PIECE_TYPES] = {0, 4, 5, 4, 2, 0};
+constexpr int MOBILITY_BASE[N_REAL_PIECE_TYPES] = {0, 4, 6, 7, 13, 0};
+
+/* king safety: attack units per attacked square around the king, by attacker type */
+constexpr int ATTACK_WEIGHT[N_REAL_PIECE_TYPES] = {0, 2, 2, 3, 5, 0};
+
+/* non-linear penalty by attack units, from https://www.chessprogramming.org/King_Safety */
+constexpr int SAFETY_TABLE[100] = {
+      0,   0,   1,   2,   3,   5,   7,   9,  12,  15,
+     18,  22,  26,  30,  35,  39,  44,  50,  56,  62,
+     68,  75,  82,  85,  89,  97, 105, 113, 122, 131,
+    140, 150, 169, 180, 191, 202, 213, 225, 237, 248,
+    260, 272, 283, 295, 307, 319, 330, 342, 354, 366,
+    377, 389, 401, 412, 424, 436, 448, 459, 471, 483,
+    494, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+};
+
+// mobility of c's pieces, counting squares that are neither own pieces nor attacked by enemy pawns
+void piece_mobility(const Position& pos, Color c, const AttackInfo& own, const AttackInfo& enemy,
+                    int& mg, int& eg) {
+    Bitboard area = ~pos.get_color_bitboard(c) & ~enemy.by_type[PAWN];
+    mg = 0;
+    eg = 0;
+    for (int i = 0; i < own.n_pieces; i++) {
+        PieceType pt = own.types[i];
+        int count = utils::popcount(own.attacks[i] & area) - MOBILITY_BASE[pt];
+        mg += MOBILITY_MG[pt] * count;
+        eg += MOBILITY_EG[pt] * count;
+    }
+}
+
+// middlegame penalty for the attacks of enemy pieces on the squares around c's king
+int king_danger(const Position& pos, Color c, const AttackInfo& enemy) {
+    Bitboard king = pos.get_bitboard(c, KING);
+    if (!king || !pos.get_bitboard(utils::opposite_color(c), QUEEN)) {
+        return 0;
+    }
+    Bitboard zone = bboard::king_attacks(bboard::bitscan_fwd(king)) | king;
+    int attackers = 0;
+    int units = 0;
+    for (int i = 0; i < enemy.n_pieces; i++) {
+        Bitboard hits = enemy.attacks[i] & zone;
+        if (hits && enemy.types[i] != KING) {
+            attackers++;
+            units += ATTACK_WEIGHT[enemy.types[i]] * utils::popcount(hits);
+        }
+    }
+    // a lone attacker is rarely dangerous
+    if (attackers < 2) {
+        return 0;
+    }
+    return SAFETY_TABLE[std::min(units, 99)];
+}
+
+/*
+Add everything but the piece-square terms to the piece-square sums mg_psqt and eg_psqt (both from
+white's point of view) and return the tapered score from the side to move's point of view. With
+Trace, also record the terms in trace.
+*/
+template <bool Trace>
+Score tapered_eval(const Position& pos, int mg_psqt, int eg_psqt, EvalTrace* trace) {
+    int mg[2];
+    int eg[2];
+
+    mg[WHITE] = mg_psqt;
+    mg[BLACK] = 0;
+    eg[WHITE] = eg_psqt;
+    eg[BLACK] = 0;
+
+    /* game phase and material imbalance */
+    material::Entry* mat_entry = material::probe(pos);
+    if (mat_entry->evaluator) {
+        // specialized endgame evaluation replaces everything else
+        Score score = mat_entry->evaluator->fn(pos, mat_entry->strong_side);
+        score = pos.get_side_to_move() == mat_entry->strong_side ? score : -score;
+        if constexpr (Trace) {
+            trace->endgame = mat_entry->evaluator->code;
+            trace->phase = mat_entry->game_phase;
+            trace->eg_scale = endgame::SCALE_NORMAL;
+            trace->total = score;
+        }
+        return score;
+    }
+    mg[WHITE] += mat_entry->imbalance;
+    eg[WHITE] += mat_entry->imbalance;
+    if constexpr (Trace) {
+        trace->mg[TERM_IMBALANCE][WHITE] = mat_entry->imbalance;
+        trace->eg[TERM_IMBALANCE][WHITE] = mat_entry->imbalance;
+    }
+
+    /* pawn structure and king shelter */
+    pawns::Entry* pawn_entry = pawns::probe(pos);
+    for (Color c : {WHITE, BLACK}) {
+        Score shield = pawn_entry->king_shield(pos, c);
+        mg[c] += pawn_entry->mg[c] + shield;
+        eg[c] += pawn_entry->eg[c];
+        if constexpr (Trace) {
+            trace->mg[TERM_PAWNS][c] = pawn_entry->mg[c];
+            trace->eg[TERM_PAWNS][c] = pawn_entry->eg[c];
+            trace->mg[TERM_KING_SHIELD][c] = shield;
+        }
+    }
+
+    /* mobility and king safety, from the attack sets shared with movegen */
+    const AttackInfo* attacks[N_COLORS] = {&pos.get_attacks(WHITE), &pos.get_attacks(BLACK)};
+    for (Color c : {WHITE, BLACK}) {
+        Color them = utils::opposite_color(c);
+        int mob_mg;
+        int mob_eg;
+        piece_mobility(pos, c, *attacks[c], *attacks[them], mob_mg, mob_eg);
+        int danger = king_danger(pos, c, *attacks[them]);
+        mg[c] += mob_mg - danger;
+        eg[c] += mob_eg;
+        if constexpr (Trace) {
+            trace->mg[TERM_MOBILITY][c] = mob_mg;
+            trace->eg[TERM_MOBILITY][c] = mob_eg;
+            trace->mg[TERM_KING_SAFETY][c] = -danger;
+        }
+    }
+
+    /* tapered eval */
+    Color side2move = pos.get_side_to_move();
+    Color otherside = utils::opposite_color(side2move);
+    int mg_score = mg[side2move] - mg[otherside];
+    int eg_score = eg[side2move] - eg[otherside];
+    int mg_phase = mat_entry->game_phase;
+    int eg_phase = 24 - mg_phase;
+
+    /* drawish material for the side that is ahead in the endgame */
+    int eg_scale = mat_entry->scale[eg[WHITE] > eg[BLACK] ? WHITE : BLACK];
+    /* bishops of opposite colors are drawish, since neither side can contest the other's squares */
+    if (mat_entry->has_endgame(material::ENDGAME_OPPOSITE_BISHOPS) &&
+        bboard::one_bit(pos.get_piece_bitboard(BISHOP) & DARK_SQUARES)) {
+        eg_scale /= 2;
+    }
+    eg_score = eg_score * eg_scale / endgame::SCALE_NORMAL;
+    Score score = (mg_score * mg_phase + eg_score * eg_phase) / 24;
+    if constexpr (Trace) {
+        trace->phase = mg_phase;
+        trace->eg_scale = eg_scale;
+        trace->total = score;
+    }
+    return score;
+}
+
+// number of positions whose piece-square terms are summed at once (one per AVX2 lane)
+constexpr size_t BATCH_LANES = 8;
+
+/*
+Fill idx[k][lane] with the index into psqt_mg/psqt_eg of the k-th piece of positions[lane], padding
+with PSQT_ZERO_SLOT. Return the largest piece count.
+*/
+int gather_psqt_indices(const Position* positions, size_t n, int32_t idx[32][BATCH_LANES]) {
+    std::fill_n(&idx[0][0], 32 * BATCH_LANES, PSQT_ZERO_SLOT * 64);
+    int max_count = 0;
+    for (size_t lane = 0; lane < n; lane++) {
+        int k = 0;
+        for (Color c : {WHITE, BLACK}) {
+            for (PieceType pt = PAWN; pt <= KING; pt = (PieceType) (pt + 1)) {
+                Bitboard bb = positions[lane].get_bitboard(c, pt);
+                while (bb && k < 32) {
+                    Square sq = bboard::bitscan_fwd_remove(bb);
+                    idx[k++][lane] = (pt * 2 + c) * 64 + sq;
+                }
+            }
+        }
+        max_count = std::max(max_count, k);
+    }
+    return max_count;
+}
+
+// evaluate up to BATCH_LANES positions
+void evaluate_lanes(const Position* positions, Score* out, size_t n) {
+    alignas(32) int32_t idx[32][BATCH_LANES];
+    alignas(32) int32_t mg[BATCH_LANES];
+    alignas(32) int32_t eg[BATCH_LANES];
+    int max_count = gather_psqt_indices(positions, n, idx);
+
+#if defined(__AVX2__)
+    __m256i mg_sum = _mm256_setzero_si256();
+    __m256i eg_sum = _mm256_setzero_si256();
+    for (int k = 0; k < max_count; k++) {
+        __m256i vidx = _mm256_load_si256((const __m256i*) idx[k]);
+        mg_sum = _mm256_add_epi32(mg_sum, _mm256_i32gather_epi32(&psqt_mg[0][0], vidx, 4));
+        eg_sum = _mm256_add_epi32(eg_sum, _mm256_i32gather_epi32(&psqt_eg[0][0], vidx, 4));
+    }
+    _mm256_store_si256((__m256i*) mg, mg_sum);
+    _mm256_store_si256((__m256i*) eg, eg_sum);
+#else
+    std::fill_n(mg, BATCH_LANES, 0);
+    std::fill_n(eg, BATCH_LANES, 0);
+    for (int k = 0; k < max_count; k++) {
+        for (size_t lane = 0; lane < BATCH_LANES; lane++) {
+            mg[lane] += (&psqt_mg[0][0])[idx[k][lane]];
+            eg[lane] += (&psqt_eg[0][0])[idx[k][lane]];
+        }
+    }
+#endif
+
+    for (size_t lane = 0; lane < n; lane++) {
+        out[lane] = tapered_eval<false>(positions[lane], mg[lane], eg[lane], nullptr);
+    }
+}
+
+void evaluate_batch_serial(const Position* positions, Score* out, size_t n) {
+    if (nnue::is_loaded()) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = compute_eval(positions[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; i += BATCH_LANES) {
+        evaluate_lanes(positions + i, out + i, std::min(BATCH_LANES, n - i));
+    }
+}
+
+template <bool Trace>
+Score classical_eval_impl(const Position& pos, EvalTrace* trace)
 {
     int mg[2];
     int eg[2];
-    int game_phase = 0;
 
     mg[WHITE] = 0;
     mg[BLACK] = 0;
@@ -289,18 +572,109 @@ Score evaluate(const Position& pos)
             int pc = sinfo.ptype * 2 + sinfo.color;  // piece and color index
             mg[sinfo.color] += mg_table[pc][sq];
             eg[sinfo.color] += eg_table[pc][sq];
-            game_phase += gamephaseInc[pc];
+            if constexpr (Trace) {
+                trace->mg[TERM_MATERIAL][sinfo.color] += mg_value[sinfo.ptype];
+                trace->eg[TERM_MATERIAL][sinfo.color] += eg_value[sinfo.ptype];
+                trace->mg[TERM_PSQT + sinfo.ptype][sinfo.color] += mg_table[pc][sq] - mg_value[sinfo.ptype];
+                trace->eg[TERM_PSQT + sinfo.ptype][sinfo.color] += eg_table[pc][sq] - eg_value[sinfo.ptype];
+            }
         }
     }
 
-    /* tapered eval */
-    Color side2move = pos.get_side_to_move();
-    Color otherside = utils::opposite_color(side2move);
-    int mg_score = mg[side2move] - mg[otherside];
-    int eg_score = eg[side2move] - eg[otherside];
-    int mg_phase = game_phase;
-    if (mg_phase > 24) mg_phase = 24; /* in case of early promotion */
-    int eg_phase = 24 - mg_phase;
-    return (mg_score * mg_phase + eg_score * eg_phase) / 24;
+    return tapered_eval<Trace>(pos, mg[WHITE] - mg[BLACK], eg[WHITE] - eg[BLACK], trace);
+}
+}  // namespace
+
+Score classical_eval(const Position& pos)
+{
+    return classical_eval_impl<false>(pos, nullptr);
+}
+
+Score trace_eval(const Position& pos, EvalTrace& trace)
+{
+    trace = EvalTrace{};
+    return classical_eval_impl<true>(pos, &trace);
+}
+
+void evaluate_batch(const Position* positions, Score* out, size_t n) {
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (n < BATCH_THREADING_MIN || n_threads == 1) {
+        evaluate_batch_serial(positions, out, n);
+        return;
+    }
+
+    // contiguous chunks, one per thread; each thread gets its own pawn and material tables
+    size_t chunk = (n + n_threads - 1) / n_threads;
+    std::vector<std::thread> workers;
+    for (size_t start = 0; start < n; start += chunk) {
+        size_t len = std::min(chunk, n - start);
+        workers.emplace_back(evaluate_batch_serial, positions + start, out + start, len);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
 }
 #endif
+
+void print_eval_trace(const Position& pos, std::ostream& os) {
+    static const char* TERM_NAMES[N_EVAL_TERMS] = {
+        "Material", "Pawn PSQT", "Knight PSQT", "Bishop PSQT", "Rook PSQT", "Queen PSQT",
+        "King PSQT", "Imbalance", "Pawns", "King shield", "King safety", "Mobility", "Check",
+    };
+    EvalTrace trace;
+    trace_eval(pos, trace);
+
+    auto cell = [&os](Score mg, Score eg) {
+        os << " " << std::setw(6) << (double) mg << " " << std::setw(6) << (double) eg << " |";
+    };
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(USE_PESTO ? 0 : 2);
+    os << "         Term |     White     |     Black     |     Total" << std::endl;
+    os << "              |     MG     EG |     MG     EG |     MG     EG" << std::endl;
+    os << " -------------+---------------+---------------+--------------" << std::endl;
+    for (int term = 0; term < N_EVAL_TERMS; term++) {
+        os << std::setw(13) << TERM_NAMES[term] << " |";
+        cell(trace.mg[term][WHITE], trace.eg[term][WHITE]);
+        cell(trace.mg[term][BLACK], trace.eg[term][BLACK]);
+        os << " " << std::setw(6) << (double) (trace.mg[term][WHITE] - trace.mg[term][BLACK])
+           << " " << std::setw(6) << (double) (trace.eg[term][WHITE] - trace.eg[term][BLACK]) << std::endl;
+    }
+    os << std::endl;
+    os << "Phase: " << trace.phase << "/24" << std::endl;
+    os << "Endgame scale: " << trace.eg_scale << "/" << endgame::SCALE_NORMAL << std::endl;
+    if (trace.endgame) {
+        os << "Specialized endgame: " << trace.endgame << " (replaces the terms above)" << std::endl;
+    }
+    os << "Classical evaluation: " << (double) trace.total << " (side to move)" << std::endl;
+    if (nnue::is_loaded()) {
+        os << "NNUE evaluation: " << (double) compute_eval(pos) << " (side to move, used in search)"
+           << std::endl;
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+Score compute_eval(const Position& pos) {
+    if (nnue::is_loaded()) {
+        // the network does not know about the specialized endgames either
+        material::Entry* mat_entry = material::probe(pos);
+        if (mat_entry->evaluator) {
+            Score score = mat_entry->evaluator->fn(pos, mat_entry->strong_side);
+            return pos.get_side_to_move() == mat_entry->strong_side ? score : -score;
+        }
+        return nnue::evaluate(pos.get_accumulator(), pos.get_side_to_move());
+    }
+    return classical_eval(pos);
+}
+
+Score evaluate(const Position& pos) {
+    ht::EvalCache& cache = ht::eval_cache();
+    Score score;
+    if (cache.probe(pos.get_hash(), score)) {
+        return score;
+    }
+    score = compute_eval(pos);
+    cache.put(pos.get_hash(), score);
+    return score;
+}
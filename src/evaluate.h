@@ -1,10 +1,78 @@
 #pragma once
 
+#include <cstddef>
+#include <iosfwd>
+
 #include "types.h"
 #include "position.h"
 
+// Evaluate pos from the side to move's point of view. Scores are cached per thread by the
+// position hash (see ht::eval_cache()).
 Score evaluate(const Position& pos);
 
+// same as evaluate() but bypasses the eval cache. Uses the NNUE network if one is loaded.
+Score compute_eval(const Position& pos);
+
+// the hand-crafted (PeSTO) evaluation
+Score classical_eval(const Position& pos);
+
+// terms of the hand-crafted evaluation, as reported by trace_eval()
+enum EvalTerm {
+    TERM_MATERIAL,
+    // piece-square terms, one per piece type; TERM_PSQT + pt
+    TERM_PSQT,
+    TERM_IMBALANCE = TERM_PSQT + N_REAL_PIECE_TYPES,
+    TERM_PAWNS,
+    TERM_KING_SHIELD,
+    TERM_KING_SAFETY,
+    TERM_MOBILITY,
+    TERM_CHECK,
+    N_EVAL_TERMS
+};
+
+// Per-term breakdown of classical_eval(). Terms are per color, each from its own point of view;
+// terms that are not part of the evaluation in this build stay zero.
+struct EvalTrace {
+    Score mg[N_EVAL_TERMS][N_COLORS];
+    Score eg[N_EVAL_TERMS][N_COLORS];
+    // PeSTO game phase, 24 for the middlegame and 0 for the endgame
+    int phase;
+    // endgame score scale factor out of endgame::SCALE_NORMAL, for drawish material
+    int eg_scale;
+    // code of the specialized endgame evaluator that replaced the terms, e.g. "KBNK", or nullptr
+    const char* endgame;
+    // the same score as classical_eval(), from the side to move's point of view
+    Score total;
+};
+
+// evaluate pos like classical_eval() and record the contribution of every term in trace
+Score trace_eval(const Position& pos, EvalTrace& trace);
+
+// print trace_eval()'s breakdown of pos as a table, followed by the NNUE score if one is loaded
+void print_eval_trace(const Position& pos, std::ostream& os);
+
+/*
+Evaluate n positions into out, with the same results as compute_eval(). Intended for offline
+scoring of large datasets: piece-square terms are summed for several positions at once with SIMD
+gathers, and batches of at least BATCH_THREADING_MIN positions are split across all cores.
+*/
+void evaluate_batch(const Position* positions, Score* out, size_t n);
+
+constexpr size_t BATCH_THREADING_MIN = 4096;
+
+/*
+Tunable PeSTO parameters (defined in evaluate.cpp). The piece-square tables are indexed by square
+for white and by utils::flip(square) for black. init_eval_tables() must be called again after they
+are changed.
+*/
+extern int mg_value[6];
+extern int eg_value[6];
+extern int* mg_pesto_table[6];
+extern int* eg_pesto_table[6];
+
+// game phase increment of each piece, indexed by piece type * 2 + color
+extern int gamephaseInc[12];
+
 void init_eval_tables();
 
 // return 1 for WHITE and -1 for BLACK. For evaluating
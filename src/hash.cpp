@@ -1,6 +1,7 @@
 #include "hash.h"
 
 #include <array>
+#include <atomic>
 #include "utils.h"
 #include "logger.h"
 
@@ -8,6 +9,13 @@
 constexpr unsigned N_ZOBRIST_PIECES = 12;
 ZobristKey table[64][N_ZOBRIST_PIECES];
 ZobristKey black_to_move;
+// one key per count of one piece type and color, 0 to N_SQUARES: a hand-made FEN can hold more
+// pieces than promotion allows
+constexpr unsigned MAX_PIECE_COUNT = N_SQUARES + 1;
+ZobristKey material_table[N_COLORS][N_REAL_PIECE_TYPES][MAX_PIECE_COUNT];
+// indexed by the castling rights bitmask
+ZobristKey castling_table[16];
+ZobristKey enpassant_table[64];
 
 
 /// hashtable stuff
@@ -22,6 +30,20 @@ void zobrist::initialize() {
 		}
 	}
 	black_to_move = prng.rand64();
+	for (unsigned c = 0; c < N_COLORS; c++) {
+		for (unsigned pt = 0; pt < N_REAL_PIECE_TYPES; pt++) {
+			for (unsigned n = 0; n < MAX_PIECE_COUNT; n++) {
+				material_table[c][pt][n] = prng.rand64();
+			}
+		}
+	}
+	// drawn last so that the keys above do not change
+	for (unsigned cr = 0; cr < 16; cr++) {
+		castling_table[cr] = prng.rand64();
+	}
+	for (unsigned sq = 0; sq < 64; sq++) {
+		enpassant_table[sq] = prng.rand64();
+	}
 }
 
 ZobristKey zobrist::get_key(Square sq, PieceType type, Color c) {
@@ -37,6 +59,21 @@ ZobristKey zobrist::get_black_to_move_key() {
 	return black_to_move;
 }
 
+ZobristKey zobrist::get_material_key(Color c, PieceType type, int count) {
+	assert(count >= 0 && (unsigned) count < MAX_PIECE_COUNT);
+	return material_table[c][type][count];
+}
+
+ZobristKey zobrist::get_castling_key(CastlingRights cr) {
+	assert(cr < 16);
+	return castling_table[cr];
+}
+
+ZobristKey zobrist::get_enpassant_key(Square sq) {
+	assert(sq < 64);
+	return enpassant_table[sq];
+}
+
 ht::Table::Table(size_t sz) : sz(sz), entries(sz, ht::Entry{}) {
 }
 
@@ -91,3 +128,67 @@ ht::Table& ht::global_table() {
 void ht::set_global_table(size_t sz) {
 	g_table = ht::Table(sz);
 }
+
+static std::atomic<unsigned> eval_generation(0);
+
+ht::EvalCache::EvalCache(size_t sz)
+	: hits(0), misses(0), generation(eval_generation), mask(sz - 1), entries(sz, EvalEntry{}) {
+	assert((sz & mask) == 0);
+}
+
+bool ht::EvalCache::probe(ZobristKey key, Score& out_score) {
+	const EvalEntry& entry = entries[key & mask];
+	if (entry.key == key) {
+		hits++;
+		out_score = entry.score;
+		return true;
+	}
+	misses++;
+	return false;
+}
+
+void ht::EvalCache::put(ZobristKey key, Score score) {
+	entries[key & mask] = EvalEntry{key, score};
+}
+
+void ht::EvalCache::clear() {
+	std::fill(entries.begin(), entries.end(), EvalEntry{});
+	reset_stats();
+}
+
+void ht::EvalCache::reset_stats() {
+	hits = 0;
+	misses = 0;
+}
+
+ht::EvalCache& ht::eval_cache() {
+	// one cache per thread, so that search threads never contend on it
+	thread_local EvalCache cache(EVAL_CACHE_SZ);
+	unsigned generation = eval_generation.load(std::memory_order_relaxed);
+	if (cache.generation != generation) {
+		cache.clear();
+		cache.generation = generation;
+	}
+	return cache;
+}
+
+void ht::invalidate_eval_caches() {
+	eval_generation++;
+}
+
+ht::PerftTable::PerftTable(size_t sz) : mask(sz - 1), entries(sz, PerftEntry{}) {
+	assert((sz & mask) == 0);
+}
+
+bool ht::PerftTable::probe(ZobristKey key, int depth, U64& out_count) const {
+	const PerftEntry& entry = entries[key & mask];
+	if (entry.key == key && entry.depth == depth) {
+		out_count = entry.count;
+		return true;
+	}
+	return false;
+}
+
+void ht::PerftTable::put(ZobristKey key, int depth, U64 count) {
+	entries[key & mask] = PerftEntry{key, count, depth};
+}
@@ -9,6 +9,12 @@ namespace zobrist {
 void initialize(void);
 ZobristKey get_key(Square, PieceType, Color);
 ZobristKey get_black_to_move_key(void);
+// key for the count-th (0-indexed) piece of a type and color; used for the material hash
+ZobristKey get_material_key(Color, PieceType, int count);
+// keys for the castling rights and the en-passant square; these are not part of the position
+// hash, but perft mixes them in since they change the move count
+ZobristKey get_castling_key(CastlingRights);
+ZobristKey get_enpassant_key(Square);
 }  // namespace zobrist
 
 namespace ht {
@@ -39,5 +45,64 @@ private:
 Table& global_table();
 void set_global_table(size_t);
 
+// Direct-mapped cache of static evaluations, keyed by the full position hash.
+class EvalCache {
+public:
+ // sz must be a power of two
+ EvalCache(size_t);
+ // return whether key is cached and if so, write its score to out_score
+ bool probe(ZobristKey key, Score& out_score);
+ // always-replace
+ void put(ZobristKey key, Score score);
+ void clear();
+ void reset_stats();
+
+ unsigned long hits;
+ unsigned long misses;
+ // value of the global eval generation when this cache was last cleared
+ unsigned generation;
+
+private:
+ struct EvalEntry {
+	ZobristKey key;
+	Score score;
+ };
+
+ size_t mask;
+ std::vector<EvalEntry> entries;  // initialized to 0's
+};
+
+constexpr size_t EVAL_CACHE_SZ = 32768;
+
+// Direct-mapped cache of perft subtree counts, keyed by the position and the remaining depth.
+class PerftTable {
+public:
+ // sz must be a power of two
+ PerftTable(size_t);
+ // return whether the count of key at depth is cached and if so, write it to out_count
+ bool probe(ZobristKey key, int depth, U64& out_count) const;
+ // always-replace
+ void put(ZobristKey key, int depth, U64 count);
+
+private:
+ struct PerftEntry {
+	ZobristKey key;
+	U64 count;
+	int depth;
+ };
+
+ size_t mask;
+ std::vector<PerftEntry> entries;  // initialized to 0's
+};
+
+constexpr size_t PERFT_TABLE_SZ = 1 << 20;
+
+// the calling thread's eval cache
+EvalCache& eval_cache();
+
+// Mark the eval caches of all threads stale, e.g. when the evaluation function changes. Each
+// cache clears itself the next time its thread accesses it.
+void invalidate_eval_caches();
+
 }  // namespace ht
 
@@ -1,16 +1,51 @@
 #include <cassert>
 #include <iostream>
+#include <string>
 
+#include "bench.h"
 #include "bitboard.h"
 #include "movegen.h"
 #include "notation.h"
 #include "uci.h"
 #include "utils.h"
 
+// whether the CPU has the instructions this build was compiled for (make ARCH=...)
+bool cpu_supports_build() {
+    __builtin_cpu_init();
+#if defined(__POPCNT__)
+    if (!__builtin_cpu_supports("popcnt")) return false;
+#endif
+#if defined(__BMI__)
+    if (!__builtin_cpu_supports("bmi")) return false;
+#endif
+#if defined(__BMI2__)
+    if (!__builtin_cpu_supports("bmi2")) return false;
+#endif
+#if defined(__AVX2__)
+    if (!__builtin_cpu_supports("avx2")) return false;
+#endif
+    return true;
+}
+
 int main(int argc, char* argv[]) {
+    // fail with a message rather than on the first illegal instruction
+    if (!cpu_supports_build()) {
+        std::cerr << "This CPU does not support the instruction set of this build; "
+                  << "rebuild with a lower ARCH" << std::endl;
+        return 1;
+    }
+
     uci::initialize(argc, argv);
 
-    uci::loop();
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        // zgkm.exe bench [depth] [threads] [hash]
+        bench::run(argc > 2 ? std::stoi(argv[2]) : bench::DEFAULT_DEPTH,
+                   argc > 3 ? std::stoi(argv[3]) : bench::DEFAULT_THREADS,
+                   argc > 4 ? std::stoi(argv[4]) : bench::DEFAULT_HASH_MB);
+    } else {
+        uci::loop();
+    }
 
+    uci::cleanup();
     return 0;
 }
@@ -0,0 +1,91 @@
+#include "material.h"
+
+#include <algorithm>
+#include "evaluate.h"
+#include "utils.h"
+
+namespace {
+
+constexpr Score BISHOP_PAIR = 30;
+// adjustment per knight/rook for each own pawn above five (Kaufman): knights gain value in closed
+// positions, rooks gain value as the board opens up
+constexpr Score KNIGHT_PAWN_ADJ = 4;
+constexpr Score ROOK_PAWN_ADJ = -8;
+
+Score imbalance(const int counts[N_REAL_PIECE_TYPES]) {
+    Score score = 0;
+    if (counts[BISHOP] >= 2) {
+        score += BISHOP_PAIR;
+    }
+    score += KNIGHT_PAWN_ADJ * counts[KNIGHT] * (counts[PAWN] - 5);
+    score += ROOK_PAWN_ADJ * counts[ROOK] * (counts[PAWN] - 5);
+    return score;
+}
+
+// value of the pieces other than pawns and the king
+inline Score non_pawn_material(const int counts[N_REAL_PIECE_TYPES]) {
+    Score npm = 0;
+    for (PieceType pt = KNIGHT; pt < KING; pt = (PieceType)(pt + 1)) {
+        npm += counts[pt] * mg_value[pt];
+    }
+    return npm;
+}
+
+void evaluate_material(const Position& pos, material::Entry& entry) {
+    int counts[N_COLORS][N_REAL_PIECE_TYPES];
+    int phase = 0;
+    for (Color c : {WHITE, BLACK}) {
+        for (PieceType pt = PAWN; pt <= KING; pt = (PieceType)(pt + 1)) {
+            counts[c][pt] = utils::popcount(pos.get_bitboard(c, pt));
+            phase += counts[c][pt] * gamephaseInc[pt * 2 + c];
+        }
+    }
+
+    entry.game_phase = std::min(phase, 24);  // in case of early promotion
+    entry.imbalance = imbalance(counts[WHITE]) - imbalance(counts[BLACK]);
+
+    entry.evaluator = endgame::find_evaluator(pos.get_material_hash(), entry.strong_side);
+
+    // without pawns, a side needs at least a rook's worth of extra material to win
+    for (Color c : {WHITE, BLACK}) {
+        Color opp_c = utils::opposite_color(c);
+        Score npm = non_pawn_material(counts[c]);
+        Score opp_npm = non_pawn_material(counts[opp_c]);
+        if (!counts[c][PAWN] && npm - opp_npm <= mg_value[BISHOP]) {
+            entry.scale[c] = npm < mg_value[ROOK] ? endgame::SCALE_DRAW : opp_npm <= mg_value[BISHOP] ? 4 : 14;
+        }
+    }
+
+    bool only_bishops = true;
+    for (Color c : {WHITE, BLACK}) {
+        only_bishops &= counts[c][BISHOP] == 1 && !counts[c][KNIGHT] && !counts[c][ROOK] &&
+                        !counts[c][QUEEN];
+    }
+    if (only_bishops) {
+        entry.endgame_flags |= material::ENDGAME_OPPOSITE_BISHOPS;
+    }
+}
+}  // namespace
+
+material::Table::Table(size_t sz) : mask(sz - 1), entries(sz) {
+    assert((sz & mask) == 0);
+}
+
+material::Entry* material::Table::probe(const Position& pos) {
+    ZobristKey key = pos.get_material_hash();
+    Entry& entry = entries[key & mask];
+    if (entry.key == key) {
+        return &entry;
+    }
+
+    entry = Entry{};
+    entry.key = key;
+    evaluate_material(pos, entry);
+    return &entry;
+}
+
+material::Entry* material::probe(const Position& pos) {
+    // one table per thread, so that search threads never contend on it
+    thread_local Table table(TABLE_SZ);
+    return table.probe(pos);
+}
@@ -0,0 +1,55 @@
+#pragma once
+/* Material evaluation, cached in a per-thread table keyed by the material hash */
+
+#include <vector>
+
+#include "endgame.h"
+#include "types.h"
+#include "position.h"
+
+namespace material {
+
+// Flags for material configurations that call for special treatment in the evaluation.
+enum EndgameFlag : uint8_t {
+    NO_ENDGAME = 0,
+    // one bishop each and nothing else but pawns; drawish if the bishops are on opposite colors
+    ENDGAME_OPPOSITE_BISHOPS = 1 << 0,
+};
+
+struct Entry {
+    ZobristKey key{};
+    // PeSTO game phase, from 0 (bare kings and pawns) to 24 (all pieces on board)
+    int game_phase{};
+    // material imbalance from white's point of view
+    Score imbalance{};
+    // specialized evaluator for this material configuration, if any
+    const endgame::Evaluator* evaluator{nullptr};
+    // the side with the extra material for the evaluator
+    Color strong_side{WHITE};
+    // endgame scale factor when c is ahead, out of endgame::SCALE_NORMAL; lowered when c has no
+    // pawns and too little extra material to win
+    uint8_t scale[N_COLORS]{endgame::SCALE_NORMAL, endgame::SCALE_NORMAL};
+    uint8_t endgame_flags{NO_ENDGAME};
+
+    inline bool has_endgame(EndgameFlag flag) const { return endgame_flags & flag; }
+};
+
+// Direct-mapped table of material entries. There are few distinct material configurations in
+// a search, so the table can be small.
+class Table {
+   public:
+    // sz must be a power of two
+    Table(size_t sz);
+    Entry* probe(const Position& pos);
+
+   private:
+    size_t mask;
+    std::vector<Entry> entries;
+};
+
+constexpr size_t TABLE_SZ = 8192;
+
+// Look up (and compute on a miss) the material entry of pos in the calling thread's table.
+Entry* probe(const Position& pos);
+
+}  // namespace material
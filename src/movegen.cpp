@@ -1,11 +1,16 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <memory>
 #include <queue>
+#include <thread>
 
 #include "movegen.h"
 #include "bitboard.h"
 #include "utils.h"
 #include "notation.h"
 #include "logger.h"
+#include "hash.h"
 
 using std::vector;
 
@@ -33,6 +38,10 @@ inline void add_promotion_moves(vector<Move>& moves, Square src,
 }
 
 inline void add_pawn_moves(vector<Move>& moves, Square src, Bitboard tgts) {
+    // bitscan_fwd is undefined on an empty board
+    if (tgts == 0ULL) {
+        return;
+    }
     // TODO no-branch if?
     if (utils::sq_rank(bboard::bitscan_fwd(tgts)) % 7 == 0) {
         add_promotion_moves(moves, src, tgts);
@@ -56,6 +65,35 @@ target_piece));
 }
 */
 
+// In Chess960 the castling rook may be all that stands between the king's target square and an
+// enemy rook or queen on the back rank. Returns whether that is the case.
+inline bool rook_shields_castling(const Position& pos, Color c, BoardSide side) {
+    if (pos.has_standard_castling()) {
+        return false;
+    }
+    Color opp_c = utils::opposite_color(c);
+    Bitboard occ = pos.get_all_bitboard() & ~bboard::mask_square(pos.get_castling_rook_source(c, side));
+    return bboard::rook_attacks(utils::king_castle_target(c, side), occ) &
+           (pos.get_bitboard(opp_c, ROOK) | pos.get_bitboard(opp_c, QUEEN));
+}
+
+// Whether c, not in check, can castle to side. The squares the king crosses are tested one by one,
+// for when there is no attack mask at hand.
+inline bool can_castle(const Position& pos, Color c, BoardSide side) {
+    if (!pos.has_castling_rights(utils::to_castling_rights(c, side)) ||
+        (pos.get_castling_between(c, side) & pos.get_all_bitboard())) {
+        return false;
+    }
+    Color opp_c = utils::opposite_color(c);
+    Bitboard passed = pos.get_castling_king_path(c, side);
+    while (passed != 0ULL) {
+        if (pos.get_attackers(bboard::bitscan_fwd_remove(passed), opp_c)) {
+            return false;
+        }
+    }
+    return !rook_shields_castling(pos, c, side);
+}
+
 // returns whether (squares are on same rank OR squares are on same file)
 inline bool same_line(Square sq1, Square sq2) {
     return (utils::sq_rank(sq1) == utils::sq_rank(sq2)) ||
@@ -110,7 +148,7 @@ bool gen_legal_moves(const Position& pos, vector<Move>& moves) {
     Bitboard all_occ = atk_occ | def_occ;
 
     Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(atk_c, KING));
-    Bitboard checkers = pos.get_attackers(king_sq, def_c);
+    Bitboard checkers = pos.get_checkers();
     int n_checks = utils::popcount(checkers);
 
     Bitboard def_attacks = pos.get_attack_mask(def_c);
@@ -123,8 +161,7 @@ bool gen_legal_moves(const Position& pos, vector<Move>& moves) {
     add_moves(moves, king_sq, king_attacks);  // add king moves regardless
 
     if (n_checks == 0) {
-        Bitboard pinner = 0ULL;
-        Bitboard pinned = absolute_pins(pos, atk_c, pinner);
+        Bitboard pinned = pos.get_pinned(atk_c);
 
         // pawns
         Bitboard pawns = pos.get_bitboard(atk_c, PAWN);
@@ -266,15 +303,17 @@ bool gen_legal_moves(const Position& pos, vector<Move>& moves) {
         // KINGSIDE)); castling
         if (pos.has_castling_rights(
                 utils::to_castling_rights(atk_c, KINGSIDE)) &&
-            !(bboard::castle_king_occ(atk_c, KINGSIDE) & def_attacks) &&
-            !(bboard::castle_between_occ(atk_c, KINGSIDE) & all_occ)) {
+            !(pos.get_castling_king_path(atk_c, KINGSIDE) & def_attacks) &&
+            !(pos.get_castling_between(atk_c, KINGSIDE) & all_occ) &&
+            !rook_shields_castling(pos, atk_c, KINGSIDE)) {
             add_castling_move(moves, atk_c, KINGSIDE);
         }
 
         if (pos.has_castling_rights(
                 utils::to_castling_rights(atk_c, QUEENSIDE)) &&
-            !(bboard::castle_king_occ(atk_c, QUEENSIDE) & def_attacks) &&
-            !(bboard::castle_between_occ(atk_c, QUEENSIDE) & all_occ)) {
+            !(pos.get_castling_king_path(atk_c, QUEENSIDE) & def_attacks) &&
+            !(pos.get_castling_between(atk_c, QUEENSIDE) & all_occ) &&
+            !rook_shields_castling(pos, atk_c, QUEENSIDE)) {
             add_castling_move(moves, atk_c, QUEENSIDE);
         }
     } else if (n_checks == 1) {
@@ -316,8 +355,7 @@ bool gen_legal_moves(const Position& pos, vector<Move>& moves) {
         }
         Bitboard check_mask = capture_mask | block_mask;
 
-        Bitboard pinner = 0ULL;
-        Bitboard pinned = absolute_pins(pos, atk_c, pinner);
+        Bitboard pinned = pos.get_pinned(atk_c);
 
         // pawns
         Bitboard free_pawns = pos.get_bitboard(atk_c, PAWN) & ~pinned;
@@ -389,43 +427,372 @@ bool gen_legal_moves(const Position& pos, vector<Move>& moves) {
     return n_checks != 0;
 }
 
-int perft(const Position& pos, int depth) {
-    Position position = pos; // make copy here
-    assert(pos.position_good());
-    int count = 0;
-    std::vector<Move> legal_moves;
+bool gen_pseudo_legal_moves(const Position& pos, vector<Move>& moves, Bitboard& out_pinned) {
+    Color atk_c = pos.get_side_to_move();
+    Color def_c = utils::opposite_color(atk_c);
+    if (pos.get_checkers() != 0ULL) {
+        // evasions are few, so generate them exactly
+        out_pinned = 0ULL;
+        return gen_legal_moves(pos, moves);
+    }
+
+    Bitboard atk_occ = pos.get_color_bitboard(atk_c);
+    Bitboard def_occ = pos.get_color_bitboard(def_c);
+    Bitboard all_occ = atk_occ | def_occ;
+    Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(atk_c, KING));
+    Bitboard pinned = pos.get_pinned(atk_c);
+    out_pinned = pinned;
+
+    // the same order as gen_legal_moves
+    add_moves(moves, king_sq, bboard::king_attacks(king_sq) & ~atk_occ);
+
+    // pawns
+    Bitboard pawns = pos.get_bitboard(atk_c, PAWN);
+    Bitboard enpassant = pos.get_enpassant();
+    Bitboard special_rank = atk_c == WHITE ? RANK_C : RANK_F;
+    while (pawns != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(pawns);
+
+        Bitboard pawn_mask = bboard::pawn_pushes(sq, atk_c) & ~all_occ;
+        // see gen_legal_moves for the 2-square pushes
+        pawn_mask |= (pawn_mask & special_rank) << ((atk_c == WHITE) * 8);
+        pawn_mask |= (pawn_mask & special_rank) >> ((atk_c == BLACK) * 8);
+        pawn_mask &= ~all_occ;
+
+        add_pawn_moves(moves, sq, pawn_mask | (bboard::pawn_attacks(sq, atk_c) & def_occ));
+        if (bboard::pawn_attacks(sq, atk_c) & enpassant) {
+            add_enpassant(moves, sq, bboard::bitscan_fwd(enpassant));
+        }
+    }
+
+    // a pinned knight can never move
+    Bitboard knights = pos.get_bitboard(atk_c, KNIGHT) & ~pinned;
+    while (knights != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(knights);
+        add_moves(moves, sq, bboard::knight_attacks(sq) & ~atk_occ);
+    }
+
+    Bitboard bishops = pos.get_bitboard(atk_c, BISHOP);
+    while (bishops != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(bishops);
+        add_moves(moves, sq, bboard::bishop_attacks(sq, all_occ) & ~atk_occ);
+    }
+
+    Bitboard rooks = pos.get_bitboard(atk_c, ROOK);
+    while (rooks != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(rooks);
+        add_moves(moves, sq, bboard::rook_attacks(sq, all_occ) & ~atk_occ);
+    }
+
+    Bitboard queens = pos.get_bitboard(atk_c, QUEEN);
+    while (queens != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(queens);
+        add_moves(moves, sq, bboard::queen_attacks(sq, all_occ) & ~atk_occ);
+    }
+
+    // castling is checked fully here, attacking only the squares the king passes
+    for (BoardSide side : {KINGSIDE, QUEENSIDE}) {
+        if (can_castle(pos, atk_c, side)) {
+            add_castling_move(moves, atk_c, side);
+        }
+    }
+    return false;
+}
+
+bool is_legal(const Position& pos, Move move, Bitboard pinned) {
+    MoveType type = get_move_type(move);
+    if (type == CASTLING_MOVE) {
+        return true;
+    }
+    Color atk_c = pos.get_side_to_move();
+    Color def_c = utils::opposite_color(atk_c);
+    Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(atk_c, KING));
+    Square src = get_move_source(move);
+    Square tgt = get_move_target(move);
+
+    if (src == king_sq) {
+        // when not in check, the king does not block any slider's attack on tgt
+        return pos.get_attackers(tgt, def_c) == 0ULL;
+    }
+
+    if (type == ENPASSANT) {
+        // two pieces leave their squares, so check the sliders directly
+        Square captured = utils::enpassant_actual(tgt, def_c);
+        Bitboard occ = (pos.get_all_bitboard() & ~bboard::mask_square(src) &
+                        ~bboard::mask_square(captured)) | bboard::mask_square(tgt);
+        Bitboard queens = pos.get_bitboard(def_c, QUEEN);
+        return !(bboard::rook_attacks(king_sq, occ) & (pos.get_bitboard(def_c, ROOK) | queens)) &&
+               !(bboard::bishop_attacks(king_sq, occ) & (pos.get_bitboard(def_c, BISHOP) | queens));
+    }
+
+    // a pinned piece may only move along the line through its king
+    return !(pinned & bboard::mask_square(src)) || utils::aligned(king_sq, src, tgt);
+}
+
+bool has_legal_move(const Position& pos, const vector<Move>& moves, Bitboard pinned) {
+    for (Move move : moves) {
+        if (is_legal(pos, move, pinned)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool move_allowed(const Position& pos, const Move& move) {
+    // only promotions use the promotion bits
+    if (move == NULL_MOVE || (get_move_type(move) != PROMOTION && (move & MOVE_PROMOTION_MASK))) {
+        return false;
+    }
+    Color atk_c = pos.get_side_to_move();
+    Color def_c = utils::opposite_color(atk_c);
+    Bitboard atk_occ = pos.get_color_bitboard(atk_c);
+    Bitboard all_occ = pos.get_all_bitboard();
+    Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(atk_c, KING));
+    Bitboard checkers = pos.get_checkers();
+    MoveType type = get_move_type(move);
+
+    if (type == CASTLING_MOVE) {
+        BoardSide side = get_move_castle_side(move);
+        return get_move_castle_color(move) == atk_c && side < N_BOARD_SIDES && !checkers &&
+               can_castle(pos, atk_c, side);
+    }
+
+    Square src = get_move_source(move);
+    Square tgt = get_move_target(move);
+    Bitboard tgt_mask = bboard::mask_square(tgt);
+    SquareInfo piece = pos.get_piece(src);
+    if (piece.color != atk_c || (tgt_mask & atk_occ)) {
+        return false;
+    }
+
+    // the move must be one the piece can make on this board
+    Bitboard def_occ = pos.get_color_bitboard(def_c);
+    Bitboard reach = 0ULL;
+    switch (piece.ptype) {
+        case PAWN:
+            if (type == ENPASSANT) {
+                reach = bboard::pawn_attacks(src, atk_c) & pos.get_enpassant();
+            } else if ((type == PROMOTION) == bool(tgt_mask & PROMOTION_RANKS)) {
+                Bitboard push = bboard::pawn_pushes(src, atk_c) & ~all_occ;
+                Bitboard special_rank = atk_c == WHITE ? RANK_C : RANK_F;
+                push |= (push & special_rank) << ((atk_c == WHITE) * 8);
+                push |= (push & special_rank) >> ((atk_c == BLACK) * 8);
+                reach = (push & ~all_occ) | (bboard::pawn_attacks(src, atk_c) & def_occ);
+            }
+            break;
+        case KNIGHT:
+            reach = bboard::knight_attacks(src);
+            break;
+        case BISHOP:
+            reach = bboard::bishop_attacks(src, all_occ);
+            break;
+        case ROOK:
+            reach = bboard::rook_attacks(src, all_occ);
+            break;
+        case QUEEN:
+            reach = bboard::queen_attacks(src, all_occ);
+            break;
+        case KING:
+            reach = bboard::king_attacks(src);
+            break;
+        default:
+            break;
+    }
+    if (!(reach & tgt_mask) || (piece.ptype != PAWN && type != NORMAL_MOVE)) {
+        return false;
+    }
+
+    if (piece.ptype == KING) {
+        // the king must not stay on the ray of a slider checking it
+        Bitboard occ = all_occ & ~bboard::mask_square(src);
+        Bitboard queens = pos.get_bitboard(def_c, QUEEN);
+        return !(pos.get_attackers(tgt, def_c) & ~(pos.get_bitboard(def_c, ROOK) |
+                                                     pos.get_bitboard(def_c, BISHOP) | queens)) &&
+               !(bboard::rook_attacks(tgt, occ) & (pos.get_bitboard(def_c, ROOK) | queens)) &&
+               !(bboard::bishop_attacks(tgt, occ) & (pos.get_bitboard(def_c, BISHOP) | queens));
+    }
+
+    if (checkers) {
+        // only a single check can be evaded by another piece, by capturing or blocking
+        if (!bboard::one_bit(checkers)) {
+            return false;
+        }
+        Square checker_sq = bboard::bitscan_fwd(checkers);
+        Bitboard evasions = checkers;
+        if (utils::is_slider(pos.get_piece(checker_sq).ptype)) {
+            evasions |= same_line(king_sq, checker_sq)
+                ? bboard::rook_attacks(king_sq, all_occ) & bboard::rook_attacks(checker_sq, all_occ)
+                : bboard::bishop_attacks(king_sq, all_occ) & bboard::bishop_attacks(checker_sq, all_occ);
+        }
+        Bitboard captured = type == ENPASSANT
+            ? bboard::mask_square(utils::enpassant_actual(tgt, def_c)) : tgt_mask;
+        if (!((captured | tgt_mask) & evasions)) {
+            return false;
+        }
+    }
+
+    return is_legal(pos, move, pos.get_pinned(atk_c));
+}
+
+namespace {
+
+// perft key: the position hash does not include the castling rights and en-passant square
+inline ZobristKey perft_key(const Position& pos) {
+    ZobristKey key = pos.get_hash() ^ zobrist::get_castling_key(pos.get_castling_rights());
+    if (pos.get_enpassant() != 0ULL) {
+        key ^= zobrist::get_enpassant_key(bboard::bitscan_fwd(pos.get_enpassant()));
+    }
+    return key;
+}
+
+// makes and unmakes moves on position; move_lists holds one move list per remaining ply so
+// that they are allocated only once
+U64 perft_impl(Position& position, int depth, vector<Move>* move_lists, ht::PerftTable* table) {
+    if (depth <= 0) {
+        return 1;
+    }
+    ZobristKey key = 0;
+    U64 count = 0;
+    // depth 1 is cheaper to count than to look up
+    if (table && depth > 1) {
+        key = perft_key(position);
+        if (table->probe(key, depth, count)) {
+            return count;
+        }
+    }
+    vector<Move>& legal_moves = move_lists[0];
+    legal_moves.clear();
     gen_legal_moves(position, legal_moves);
+    // bulk-count the leaves instead of making each move
     if (depth == 1) {
         return legal_moves.size();
     }
     for (Move move : legal_moves) {
         position.make_move(move);
         assert(position.position_good());
-        count += perft(position, depth - 1);
+        count += perft_impl(position, depth - 1, move_lists + 1, table);
         position.unmake_move(move);
         assert(position.position_good());
     }
+    if (table) {
+        table->put(key, depth, count);
+    }
     return count;
 }
 
-void divide(Position& position, int depth) {
-    long total = 0;
-    vector<Move> legal_moves;
-    gen_legal_moves(position, legal_moves);
-    if (depth == 1) {
-        total = legal_moves.size();
-        for (Move move : legal_moves) {
-            LOG(logINFO) << notation::dump_uci_move(move) << ": 1";
+// A root move, or a root move and a reply, whose subtree one worker counts
+struct PerftTask {
+    int root_index;
+    int n_moves;
+    Move moves[2];
+};
+
+// Count the subtree of each legal root move of pos, split across n_threads workers. When there
+// are too few root moves to keep the workers busy, each depth-2 subtree is a task instead.
+vector<U64> perft_root_moves(const Position& pos, int depth, int n_threads, size_t table_sz,
+                             vector<Move>& out_legal_moves) {
+    Position position = pos;
+    out_legal_moves.clear();
+    gen_legal_moves(position, out_legal_moves);
+    const int n_root = out_legal_moves.size();
+    if (depth <= 1) {
+        return vector<U64>(n_root, 1);
+    }
+
+    vector<PerftTask> tasks;
+    bool split = depth > 2 && n_root < 2 * n_threads;
+    vector<Move> replies;
+    for (int i = 0; i < n_root; i++) {
+        Move move = out_legal_moves[i];
+        if (!split) {
+            tasks.push_back(PerftTask{i, 1, {move, NULL_MOVE}});
+            continue;
         }
-    } else {
-        for (Move move : legal_moves) {
-            position.make_move(move);
-            long count = perft(position, depth - 1);
-            position.unmake_move(move);
-            total += count;
-            LOG(logINFO) << notation::dump_uci_move(move) << ": " << count;
+        position.make_move(move);
+        replies.clear();
+        gen_legal_moves(position, replies);
+        for (Move reply : replies) {
+            tasks.push_back(PerftTask{i, 2, {move, reply}});
         }
+        position.unmake_move(move);
+    }
+
+    std::unique_ptr<std::atomic<U64>[]> counts(new std::atomic<U64>[n_root]);
+    for (int i = 0; i < n_root; i++) {
+        counts[i] = 0;
+    }
+    std::atomic<size_t> next_task(0);
+    const int n_workers = std::max(1, std::min<int>(n_threads, tasks.size()));
+    // each worker has its own table, so entries are never written concurrently; the workers
+    // split the table_sz entries, each taking the largest power of two that fits its share
+    size_t worker_table_sz = table_sz > 0 ? 1 : 0;
+    while (worker_table_sz > 0 && worker_table_sz * 2 * n_workers <= table_sz) {
+        worker_table_sz *= 2;
+    }
+    vector<std::thread> workers;
+    for (int t = 0; t < n_workers; t++) {
+        workers.emplace_back([&] {
+            std::unique_ptr<ht::PerftTable> table;
+            if (worker_table_sz > 0) {
+                table = std::make_unique<ht::PerftTable>(worker_table_sz);
+            }
+            Position worker_pos = pos;
+            vector<vector<Move>> move_lists(depth);
+            for (size_t i = next_task++; i < tasks.size(); i = next_task++) {
+                const PerftTask& task = tasks[i];
+                for (int m = 0; m < task.n_moves; m++) {
+                    worker_pos.make_move(task.moves[m]);
+                }
+                counts[task.root_index] +=
+                    perft_impl(worker_pos, depth - task.n_moves, move_lists.data(), table.get());
+                for (int m = task.n_moves - 1; m >= 0; m--) {
+                    worker_pos.unmake_move(task.moves[m]);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    vector<U64> ret(n_root);
+    for (int i = 0; i < n_root; i++) {
+        ret[i] = counts[i];
+    }
+    return ret;
+}
+
+}  // namespace
+
+U64 perft(const Position& pos, int depth, ht::PerftTable* table) {
+    assert(pos.position_good());
+    Position position = pos; // the only copy
+    vector<vector<Move>> move_lists(std::max(depth, 1));
+    return perft_impl(position, depth, move_lists.data(), table);
+}
+
+U64 perft(const Position& pos, int depth, int n_threads, size_t table_sz) {
+    vector<Move> legal_moves;
+    vector<U64> counts = perft_root_moves(pos, depth, n_threads, table_sz, legal_moves);
+    U64 total = 0;
+    for (U64 count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+void divide(const Position& pos, int depth, int n_threads, size_t table_sz) {
+    utils::Timer timer;
+    vector<Move> legal_moves;
+    vector<U64> counts = perft_root_moves(pos, depth, n_threads, table_sz, legal_moves);
+    double elapsed = timer.elapsed_millis();
+    U64 total = 0;
+    for (size_t i = 0; i < legal_moves.size(); i++) {
+        total += counts[i];
+        LOG(logINFO) << notation::dump_uci_move(legal_moves[i], pos) << ": " << counts[i];
     }
     LOG(logINFO) << "Moves: " << legal_moves.size();
     LOG(logINFO) << "Nodes: " << total;
+    LOG(logINFO) << "Time (ms): " << (U64) elapsed;
+    LOG(logINFO) << "Nodes/second: " << (U64) (total * 1000. / std::max(elapsed, 1.));
 }
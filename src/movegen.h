@@ -4,6 +4,7 @@
 #include <unordered_map>
 
 #include "position.h"
+#include "hash.h"
 
 
 Bitboard absolute_pins(const Position& pos, Color pinned_color,
@@ -13,11 +14,31 @@ Bitboard absolute_pins(const Position& pos, Color pinned_color,
 // being checked.
 bool gen_legal_moves(const Position& position, std::vector<Move>& out_moves);
 
-bool move_allowed(const Position &position, const Move &move);
+// Generate pseudo-legal moves, which may leave the king in check, and return whether the side to
+// move is being checked. Filter them with is_legal() as they are tried, passing out_pinned, the
+// pieces pinned to the king. Castling moves are fully checked, and when in check the moves are
+// the legal evasions of gen_legal_moves().
+bool gen_pseudo_legal_moves(const Position& position, std::vector<Move>& out_moves, Bitboard& out_pinned);
+
+// whether a move from gen_pseudo_legal_moves() is legal; pinned is its out_pinned
+bool is_legal(const Position& position, Move move, Bitboard pinned);
+
+// whether any of the moves from gen_pseudo_legal_moves() is legal
+bool has_legal_move(const Position& position, const std::vector<Move>& moves, Bitboard pinned);
+
+// Whether move, e.g. one from the hash table, is legal in the position, without generating any
+// moves. Any 16-bit value is accepted.
+bool move_allowed(const Position& position, const Move& move);
 
 void test_absolute_pins(Position& position);
 
-// generate move count for perft
-int perft(const Position& position, int depth);
+// count the leaf nodes of the legal move tree to depth; if table is given, subtree counts are
+// cached in it
+U64 perft(const Position& position, int depth, ht::PerftTable* table = nullptr);
+
+// perft split across n_threads workers by root move, each worker hashing in its own table; the
+// tables hold table_sz entries in total (no hashing if 0)
+U64 perft(const Position& position, int depth, int n_threads, size_t table_sz);
 
-void divide(const Position& position, int depth);
+// print the perft count of each legal move, then the total and the nodes per second
+void divide(const Position& position, int depth, int n_threads, size_t table_sz);
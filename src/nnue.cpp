@@ -0,0 +1,206 @@
+#include "nnue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "hash.h"
+#include "logger.h"
+#include "utils.h"
+
+namespace {
+
+struct Network {
+    alignas(32) int16_t l1_weights[nnue::N_INPUTS][nnue::N_HIDDEN];
+    alignas(32) int16_t l1_biases[nnue::N_HIDDEN];
+    alignas(32) int16_t l2_weights[nnue::N_L2][2 * nnue::N_HIDDEN];
+    int32_t l2_biases[nnue::N_L2];
+    int16_t out_weights[nnue::N_L2];
+    int32_t out_bias;
+};
+
+std::unique_ptr<Network> network;
+// read by the search threads on every make_move; the UCI thread only changes the network while no
+// search is running (see run_setoption)
+std::atomic<bool> loaded(false);
+
+constexpr char MAGIC[8] = {'Z', 'G', 'K', 'M', 'N', 'N', '0', '1'};
+
+inline int feature_index(Color perspective, Square sq, Color c, PieceType piece) {
+    int rel_sq = perspective == WHITE ? sq : utils::flip(sq);
+    return ((c != perspective) * 6 + piece) * 64 + rel_sq;
+}
+
+// acc += weights (add) or acc -= weights, N_HIDDEN elements
+template <bool Add>
+inline void update(int16_t* acc, const int16_t* weights) {
+#if defined(__AVX2__)
+    for (int i = 0; i < nnue::N_HIDDEN; i += 16) {
+        __m256i a = _mm256_load_si256((const __m256i*)(acc + i));
+        __m256i w = _mm256_load_si256((const __m256i*)(weights + i));
+        a = Add ? _mm256_add_epi16(a, w) : _mm256_sub_epi16(a, w);
+        _mm256_store_si256((__m256i*)(acc + i), a);
+    }
+#elif defined(__SSE2__)
+    for (int i = 0; i < nnue::N_HIDDEN; i += 8) {
+        __m128i a = _mm_load_si128((const __m128i*)(acc + i));
+        __m128i w = _mm_load_si128((const __m128i*)(weights + i));
+        a = Add ? _mm_add_epi16(a, w) : _mm_sub_epi16(a, w);
+        _mm_store_si128((__m128i*)(acc + i), a);
+    }
+#else
+    for (int i = 0; i < nnue::N_HIDDEN; i++) {
+        acc[i] = Add ? acc[i] + weights[i] : acc[i] - weights[i];
+    }
+#endif
+}
+
+// out = clamp(in, 0, QA), n elements
+inline void clipped_relu(int16_t* out, const int16_t* in, int n) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(nnue::QA);
+    for (int i = 0; i < n; i += 16) {
+        __m256i v = _mm256_load_si256((const __m256i*)(in + i));
+        v = _mm256_min_epi16(_mm256_max_epi16(v, zero), qa);
+        _mm256_store_si256((__m256i*)(out + i), v);
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(nnue::QA);
+    for (int i = 0; i < n; i += 8) {
+        __m128i v = _mm_load_si128((const __m128i*)(in + i));
+        v = _mm_min_epi16(_mm_max_epi16(v, zero), qa);
+        _mm_store_si128((__m128i*)(out + i), v);
+    }
+#else
+    for (int i = 0; i < n; i++) {
+        out[i] = std::clamp<int16_t>(in[i], 0, nnue::QA);
+    }
+#endif
+}
+
+// dot product of two int16 vectors of length n, accumulated in int32
+inline int32_t dot(const int16_t* a, const int16_t* b, int n) {
+#if defined(__AVX2__)
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n; i += 16) {
+        __m256i va = _mm256_load_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_load_si256((const __m256i*)(b + i));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(va, vb));
+    }
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum128);
+#elif defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 8) {
+        __m128i va = _mm_load_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_load_si128((const __m128i*)(b + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(va, vb));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += (int32_t) a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+template <typename T>
+bool read_array(std::istream& is, T* data, size_t n) {
+    is.read(reinterpret_cast<char*>(data), sizeof(T) * n);
+    return (bool) is;
+}
+}  // namespace
+
+bool nnue::load(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+        LOG(logERROR) << "Could not open network file '" << path << "'";
+        return false;
+    }
+
+    char magic[8];
+    int32_t dims[3];
+    if (!read_array(is, magic, 8) || std::memcmp(magic, MAGIC, 8) != 0 ||
+        !read_array(is, dims, 3) || dims[0] != N_INPUTS || dims[1] != N_HIDDEN || dims[2] != N_L2) {
+        LOG(logERROR) << "Network file '" << path << "' has the wrong format";
+        return false;
+    }
+
+    auto net = std::make_unique<Network>();
+    bool good = read_array(is, &net->l1_weights[0][0], N_INPUTS * N_HIDDEN) &&
+                read_array(is, net->l1_biases, N_HIDDEN) &&
+                read_array(is, &net->l2_weights[0][0], N_L2 * 2 * N_HIDDEN) &&
+                read_array(is, net->l2_biases, N_L2) &&
+                read_array(is, net->out_weights, N_L2) &&
+                read_array(is, &net->out_bias, 1);
+    if (!good) {
+        LOG(logERROR) << "Network file '" << path << "' is truncated";
+        return false;
+    }
+
+    network = std::move(net);
+    loaded.store(true, std::memory_order_release);
+    // cached scores came from the previous evaluation function
+    ht::invalidate_eval_caches();
+    return true;
+}
+
+void nnue::unload() {
+    loaded.store(false, std::memory_order_release);
+    network.reset();
+    ht::invalidate_eval_caches();
+}
+
+bool nnue::is_loaded() {
+    return loaded.load(std::memory_order_acquire);
+}
+
+void nnue::reset(Accumulator& acc) {
+    for (Color c : {WHITE, BLACK}) {
+        std::copy_n(network->l1_biases, N_HIDDEN, acc.values[c]);
+    }
+}
+
+void nnue::add_feature(Accumulator& acc, Square sq, Color c, PieceType piece) {
+    for (Color perspective : {WHITE, BLACK}) {
+        update<true>(acc.values[perspective],
+                     network->l1_weights[feature_index(perspective, sq, c, piece)]);
+    }
+}
+
+void nnue::remove_feature(Accumulator& acc, Square sq, Color c, PieceType piece) {
+    for (Color perspective : {WHITE, BLACK}) {
+        update<false>(acc.values[perspective],
+                      network->l1_weights[feature_index(perspective, sq, c, piece)]);
+    }
+}
+
+Score nnue::evaluate(const Accumulator& acc, Color side_to_move) {
+    alignas(32) int16_t l1_out[2 * N_HIDDEN];
+    clipped_relu(l1_out, acc.values[side_to_move], N_HIDDEN);
+    clipped_relu(l1_out + N_HIDDEN, acc.values[utils::opposite_color(side_to_move)], N_HIDDEN);
+
+    int32_t output = network->out_bias;
+    for (int j = 0; j < N_L2; j++) {
+        // scale QA * QB -> QB, then clip at 1.0
+        int32_t sum = network->l2_biases[j] + dot(l1_out, network->l2_weights[j], 2 * N_HIDDEN);
+        int32_t l2_out = std::clamp(sum / QA, 0, QB);
+        output += l2_out * network->out_weights[j];
+    }
+
+    return (Score) ((int64_t) output * OUTPUT_SCALE / (QB * QB));
+}
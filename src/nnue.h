@@ -0,0 +1,65 @@
+#pragma once
+/*
+ * Optional efficiently updatable neural network (NNUE) evaluation.
+ *
+ * Architecture: 768 -> 2x256 -> 32 -> 1
+ * - Input features are (piece color relative to the perspective, piece type, square), with
+ *   squares flipped vertically for black's perspective, i.e. 2 * 6 * 64 = 768 features.
+ * - The first layer is kept as one int16 accumulator per perspective and updated incrementally
+ *   whenever a piece is added or removed (see Position::add_piece/remove_piece).
+ * - The side to move's accumulator is concatenated with the other side's, then passed through
+ *   clipped ReLU, a 512 -> 32 dense layer, clipped ReLU again and a 32 -> 1 output layer.
+ *
+ * Network file format (all little-endian):
+ *   char[8]  magic "ZGKMNN01"
+ *   int32    N_INPUTS, N_HIDDEN, N_L2 (must match the constants below)
+ *   int16    l1_weights[N_INPUTS][N_HIDDEN]     scale QA
+ *   int16    l1_biases[N_HIDDEN]                scale QA
+ *   int16    l2_weights[N_L2][2 * N_HIDDEN]     scale QB
+ *   int32    l2_biases[N_L2]                    scale QA * QB
+ *   int16    out_weights[N_L2]                  scale QB
+ *   int32    out_bias                           scale QB * QB
+ */
+
+#include <cstdint>
+#include <string>
+
+#include "types.h"
+
+namespace nnue {
+
+constexpr int N_INPUTS = 2 * 6 * 64;
+constexpr int N_HIDDEN = 256;
+constexpr int N_L2 = 32;
+
+// quantization scales; QA is also the clipping value of the first layer's activations
+constexpr int QA = 255;
+constexpr int QB = 64;
+// converts the network's output (in units of 1/QB^2) to centipawns
+constexpr int OUTPUT_SCALE = 400;
+
+struct Accumulator {
+    // indexed by perspective
+    alignas(32) int16_t values[N_COLORS][N_HIDDEN];
+};
+
+// Load network weights from path. Return whether successful; on failure, the previously loaded
+// network (if any) is kept.
+bool load(const std::string& path);
+
+// unload the network so that the hand-crafted evaluation is used
+void unload();
+
+bool is_loaded();
+
+// set the accumulator to the first layer's biases, i.e. an empty board
+void reset(Accumulator& acc);
+
+void add_feature(Accumulator& acc, Square sq, Color c, PieceType piece);
+
+void remove_feature(Accumulator& acc, Square sq, Color c, PieceType piece);
+
+// evaluate from side_to_move's point of view, in centipawns
+Score evaluate(const Accumulator& acc, Color side_to_move);
+
+}  // namespace nnue
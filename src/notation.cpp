@@ -12,6 +12,23 @@ Square parse_square(const char* buf) {
     int rank = buf[1] - '1';
     return utils::make_square(rank, file);
 }
+
+// the rook of c furthest towards side on c's back rank, or N_SQUARES if there is none
+Square outermost_rook(const Position& pos, Color c, BoardSide side) {
+    Bitboard rooks = pos.get_bitboard(c, ROOK) & (c == WHITE ? RANK_A : RANK_H);
+    Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(c, KING));
+    Square found = N_SQUARES;
+    while (rooks != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(rooks);
+        // rooks are scanned from the a-file, so the last one on the kingside is the outermost
+        if (side == KINGSIDE && sq > king_sq) {
+            found = sq;
+        } else if (side == QUEENSIDE && sq < king_sq && found == N_SQUARES) {
+            found = sq;
+        }
+    }
+    return found;
+}
 }
 
 // Given a target square for castling, return whether it is kingside.
@@ -115,6 +132,18 @@ std::string notation::pretty_move(Move mv, const std::vector<Move>& legal_moves,
     return std::string(buf);
 }
 
+std::string notation::dump_uci_move(Move mv, const Position& pos) {
+    if (get_move_type(mv) != CASTLING_MOVE) {
+        return dump_uci_move(mv);
+    }
+    BoardSide side = get_move_castle_side(mv);
+    Color color = get_move_castle_color(mv);
+    // in Chess960 the king captures its own rook
+    Square tgt = pos.is_chess960() ? pos.get_castling_rook_source(color, side)
+                                   : utils::king_castle_target(color, side);
+    return square_str(pos.get_castling_king_source(color)) + square_str(tgt);
+}
+
 std::string notation::dump_uci_move(Move mv) {
     MoveType type = get_move_type(mv);
     if (type == CASTLING_MOVE) {
@@ -132,21 +161,22 @@ std::string notation::dump_uci_move(Move mv) {
 }
 
 Move notation::parse_uci_move(const Position& pos, const std::string& mv_str) {
-    // test for castling moves
-    if (mv_str == "e1g1" && pos.has_castling_rights(WHITE_OO)) {
-        // white king-side castle
-        return create_castling_move(WHITE, KINGSIDE);
-    } else if (mv_str == "e1c1" && pos.has_castling_rights(WHITE_OOO)) {
-        return create_castling_move(WHITE, QUEENSIDE);
-    } else if (mv_str == "e8g8" && pos.has_castling_rights(BLACK_OO)) {
-        return create_castling_move(BLACK, KINGSIDE);
-    } else if (mv_str == "e8c8" && pos.has_castling_rights(BLACK_OOO)) {
-        return create_castling_move(BLACK, QUEENSIDE);
-    }
-
     const char* mv_buf = mv_str.c_str();
     Square src = parse_square(mv_buf);
     Square dest = parse_square(mv_buf + 2);
+
+    // test for castling moves: the king capturing its own rook, or in standard chess, the king
+    // moving to its target square
+    Color color = pos.get_side_to_move();
+    if (src == pos.get_castling_king_source(color)) {
+        for (BoardSide side : {KINGSIDE, QUEENSIDE}) {
+            if (pos.has_castling_rights(utils::to_castling_rights(color, side)) &&
+                (dest == pos.get_castling_rook_source(color, side) ||
+                 (pos.has_standard_castling() && dest == utils::king_castle_target(color, side)))) {
+                return create_castling_move(color, side);
+            }
+        }
+    }
     // Color to_move = pos.get_side_to_move();
 
     if (bboard::mask_square(dest) == pos.get_enpassant()) {
@@ -220,17 +250,18 @@ std::string notation::to_aligned_fen(const Position& pos) {
     if (rights == NO_CASTLING_RIGHTS) {
         postfix += "-";
     } else {
-        if (rights & WHITE_OO) {
-            postfix += "K";
-        }
-        if (rights & WHITE_OOO) {
-            postfix += "Q";
-        }
-        if (rights & BLACK_OO) {
-            postfix += "k";
-        }
-        if (rights & BLACK_OOO) {
-            postfix += "q";
+        // X-FEN: KQkq unless another rook stands further out than the castling rook, in which
+        // case the file of the castling rook is given instead
+        for (Color c : {WHITE, BLACK}) {
+            for (BoardSide side : {KINGSIDE, QUEENSIDE}) {
+                if (!(rights & utils::to_castling_rights(c, side))) {
+                    continue;
+                }
+                Square rook_sq = pos.get_castling_rook_source(c, side);
+                char ch = rook_sq == outermost_rook(pos, c, side) ? (side == KINGSIDE ? 'k' : 'q')
+                                                                  : file_char(utils::sq_file(rook_sq));
+                postfix += c == WHITE ? (char) std::toupper(ch) : (char) std::tolower(ch);
+            }
         }
     }
     postfix += " ";
@@ -317,28 +348,32 @@ void Position::load_fen(std::istream& fen_is) {
 
     side_to_move = (Color)(stom == 'b');
 
+    // KQkq (the outermost rook on that side of the king), or the file of the rook as in
+    // Shredder-FEN and X-FEN for Chess960
     CastlingRights c_rights = NO_CASTLING_RIGHTS;
     if (castling_rights != "-") {
-        assert(castling_rights.length() <= 4);
+        castling.rights_masks = {};
         for (auto it = castling_rights.begin(); it != castling_rights.end();
              it++) {
-            switch (*it) {
-                case 'K':
-                    c_rights |= WHITE_OO;
-                    break;
-                case 'Q':
-                    c_rights |= WHITE_OOO;
-                    break;
-                case 'k':
-                    c_rights |= BLACK_OO;
-                    break;
-                case 'q':
-                    c_rights |= BLACK_OOO;
-                    break;
-                default:
-                    assert(false);
-                    break;
+            Color c = std::isupper(*it) ? WHITE : BLACK;
+            char ch = std::tolower(*it);
+            Square king_sq = bboard::bitscan_fwd(get_bitboard(c, KING));
+            Square rook_sq = N_SQUARES;
+            BoardSide side = KINGSIDE;
+            if (ch == 'k' || ch == 'q') {
+                side = ch == 'k' ? KINGSIDE : QUEENSIDE;
+                rook_sq = outermost_rook(*this, c, side);
+            } else if (ch >= 'a' && ch <= 'h') {
+                rook_sq = utils::make_square(c == WHITE ? 0 : 7, ch - 'a');
+                side = rook_sq > king_sq ? KINGSIDE : QUEENSIDE;
+            }
+            if (rook_sq == N_SQUARES || get_piece(rook_sq).ptype != ROOK ||
+                get_piece(rook_sq).color != c || utils::relative_rank(king_sq, c) != 0) {
+                LOG(logWARNING) << "Ignoring castling right '" << *it << "'";
+                continue;
             }
+            c_rights |= utils::to_castling_rights(c, side);
+            set_castling_squares(c, side, king_sq, rook_sq);
         }
     }
     set_castling_rights(c_rights);
@@ -356,6 +391,8 @@ void Position::load_fen(std::istream& fen_is) {
     set_fullmove_number(fullmove_number);
 
     hash = compute_hash();
+    pawn_hash = compute_pawn_hash();
+    material_hash = compute_material_hash();
 	pos_counts.clear();
     pos_counts[hash] = 1;
 }
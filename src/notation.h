@@ -36,9 +36,13 @@ move_idx:       Index of the move that should be printed
 std::string pretty_move(Move mv, const std::vector<Move>& legal_moves,
                         const Position& pos, bool checking);
 
-// UCI format move
+// UCI format move; castling moves are written as in standard chess
 std::string dump_uci_move(Move mv);
 
+// UCI format move, writing castling moves from the castling squares of pos, and as the king
+// capturing its rook if pos.is_chess960()
+std::string dump_uci_move(Move mv, const Position& pos);
+
 Move parse_uci_move(const Position& pos, const std::string& mv_str);
 
 // TODO
@@ -0,0 +1,117 @@
+#include "pawns.h"
+
+#include "bitboard.h"
+#include "utils.h"
+
+namespace {
+
+// bonus for a passed pawn, indexed by relative rank
+constexpr Score PASSED_MG[8] = {0, 5, 10, 15, 25, 40, 60, 0};
+constexpr Score PASSED_EG[8] = {0, 10, 15, 25, 45, 70, 110, 0};
+
+constexpr Score ISOLATED_MG = -5;
+constexpr Score ISOLATED_EG = -10;
+// penalty for each pawn that has another friendly pawn in front of it on the same file
+constexpr Score DOUBLED_MG = -10;
+constexpr Score DOUBLED_EG = -20;
+constexpr Score BACKWARD_MG = -8;
+constexpr Score BACKWARD_EG = -6;
+
+// bonus for each shield pawn one and two ranks in front of the king
+constexpr Score SHIELD_NEAR = 10;
+constexpr Score SHIELD_FAR = 5;
+
+void evaluate_pawns(const Position& pos, Color c, pawns::Entry& entry) {
+    Color opp_c = utils::opposite_color(c);
+    Bitboard own = pos.get_bitboard(c, PAWN);
+    Bitboard opp = pos.get_bitboard(opp_c, PAWN);
+
+    Score mg = 0;
+    Score eg = 0;
+    Bitboard passed = 0ULL;
+
+    Bitboard pawns = own;
+    while (pawns) {
+        Square sq = bboard::bitscan_fwd_remove(pawns);
+        int file = utils::sq_file(sq);
+        Bitboard file_bb = bboard::file_mask(file);
+        Bitboard adjacent = bboard::adjacent_files_mask(file);
+        Bitboard front = bboard::forward_ranks_mask(c, sq);
+
+        if (!(opp & front & (file_bb | adjacent))) {
+            passed |= bboard::mask_square(sq);
+            mg += PASSED_MG[utils::relative_rank(sq, c)];
+            eg += PASSED_EG[utils::relative_rank(sq, c)];
+        }
+
+        if (own & front & file_bb) {
+            mg += DOUBLED_MG;
+            eg += DOUBLED_EG;
+        }
+
+        if (!(own & adjacent)) {
+            mg += ISOLATED_MG;
+            eg += ISOLATED_EG;
+        } else if (!(own & adjacent & ~front)) {
+            // no friendly pawn beside or behind it can ever defend it; backward if the stop
+            // square is controlled by an enemy pawn
+            Square stop = utils::to_square(sq + utils::pawn_direction(c) * 8);
+            if (bboard::pawn_attacks(stop, c) & opp) {
+                mg += BACKWARD_MG;
+                eg += BACKWARD_EG;
+            }
+        }
+    }
+
+    entry.mg[c] = mg;
+    entry.eg[c] = eg;
+    entry.passed[c] = passed;
+}
+}  // namespace
+
+Score pawns::Entry::king_shield(const Position& pos, Color c) {
+    Square king_sq = bboard::bitscan_fwd(pos.get_bitboard(c, KING));
+    if (king_sq == king_squares[c]) {
+        return shield[c];
+    }
+
+    Score score = 0;
+    // only a king on its first two ranks is sheltered
+    if (utils::relative_rank(king_sq, c) <= 1) {
+        int file = utils::sq_file(king_sq);
+        Bitboard files = bboard::file_mask(file) | bboard::adjacent_files_mask(file);
+        int near_rank = utils::sq_rank(king_sq) + utils::pawn_direction(c);
+        int far_rank = near_rank + utils::pawn_direction(c);
+        Bitboard own = pos.get_bitboard(c, PAWN) & files;
+        score += SHIELD_NEAR * utils::popcount(own & bboard::rank_mask(near_rank));
+        score += SHIELD_FAR * utils::popcount(own & bboard::rank_mask(far_rank));
+    }
+
+    king_squares[c] = king_sq;
+    shield[c] = score;
+    return score;
+}
+
+pawns::Table::Table(size_t sz) : mask(sz - 1), entries(sz) {
+    assert((sz & mask) == 0);
+}
+
+pawns::Entry* pawns::Table::probe(const Position& pos) {
+    ZobristKey key = pos.get_pawn_hash();
+    Entry& entry = entries[key & mask];
+    if (entry.key == key) {
+        return &entry;
+    }
+
+    entry = Entry{};
+    entry.key = key;
+    evaluate_pawns(pos, WHITE, entry);
+    evaluate_pawns(pos, BLACK, entry);
+    return &entry;
+}
+
+pawns::Entry* pawns::probe(const Position& pos) {
+    // one table per thread, so that search threads never contend on it
+    thread_local Table table(TABLE_SZ);
+    return table.probe(pos);
+}
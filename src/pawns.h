@@ -0,0 +1,45 @@
+#pragma once
+/* Pawn structure evaluation, cached in a per-thread table keyed by the pawn hash */
+
+#include <vector>
+
+#include "types.h"
+#include "position.h"
+
+namespace pawns {
+
+struct Entry {
+    ZobristKey key{};
+    // pawn structure terms (passed, isolated, doubled, backward) for each color
+    Score mg[N_COLORS]{};
+    Score eg[N_COLORS]{};
+    Bitboard passed[N_COLORS]{};  // passed pawns of each color
+
+    // Return the pawn shield score of c's king. The shield only depends on
+    // the pawns and the king square, so it is cached for the last king square.
+    Score king_shield(const Position& pos, Color c);
+
+    // N_SQUARES so that the shield is computed on first use
+    Square king_squares[N_COLORS]{N_SQUARES, N_SQUARES};
+    Score shield[N_COLORS]{};
+};
+
+// Direct-mapped table of pawn entries. Pawn structure rarely changes within a search, so the
+// hit rate is very high and the table can be small.
+class Table {
+   public:
+    // sz must be a power of two
+    Table(size_t sz);
+    Entry* probe(const Position& pos);
+
+   private:
+    size_t mask;
+    std::vector<Entry> entries;
+};
+
+constexpr size_t TABLE_SZ = 16384;
+
+// Look up (and compute on a miss) the pawn entry of pos in the calling thread's table.
+Entry* probe(const Position& pos);
+
+}  // namespace pawns
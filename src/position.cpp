@@ -6,8 +6,10 @@
 #include "hash.h"
 #include "notation.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstring>
 #include <istream>
 #include <sstream>
 #include <iostream>
@@ -15,7 +17,20 @@
 using std::string;
 using std::vector;
 
-namespace {}  // namespace
+namespace {
+void compute_accumulator(const Position& pos, nnue::Accumulator& acc) {
+    nnue::reset(acc);
+    for (Color c : {WHITE, BLACK}) {
+        for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType)(pt + 1)) {
+            Bitboard bb = pos.get_bitboard(c, pt);
+            while (bb) {
+                Square sq = bboard::bitscan_fwd_remove(bb);
+                nnue::add_feature(acc, sq, c, pt);
+            }
+        }
+    }
+}
+}  // namespace
 
 Position::Position() {
     // initialization of members is done in load_fen
@@ -38,8 +53,16 @@ Position::Position(const Position& other)
       halfmove_clock{other.halfmove_clock},
       fullmove_number{other.fullmove_number},
       hash{other.hash},
+      pawn_hash{other.pawn_hash},
+      material_hash{other.material_hash},
       pos_counts{other.pos_counts},
-      info_board{other.info_board} {}
+      castling{other.castling},
+      chess960{other.chess960},
+      info_board{other.info_board} {
+    if (nnue::is_loaded()) {
+        accumulator = other.accumulator;
+    }
+}
 
 Position& Position::operator=(const Position& other) {
     side_to_move = other.side_to_move;
@@ -50,8 +73,16 @@ Position& Position::operator=(const Position& other) {
     halfmove_clock = other.halfmove_clock;
     fullmove_number = other.fullmove_number;
     hash = other.hash;
+    pawn_hash = other.pawn_hash;
+    material_hash = other.material_hash;
     pos_counts = other.pos_counts;
+    castling = other.castling;
+    chess960 = other.chess960;
     info_board = other.info_board;
+    invalidate_caches();
+    if (nnue::is_loaded()) {
+        accumulator = other.accumulator;
+    }
     return *this;
 }
 
@@ -101,10 +132,11 @@ void Position::make_move(Move move) {
         // TODO maybe hardcoding in / constexpr'ing mask_square makes this
         // faster?
 
+        // remove both before adding, since in Chess960 the targets may be the sources
         // remove rook
-        remove_piece(utils::rook_castle_source(color, side), color, ROOK);
+        remove_piece(castling.rook_source[color][side], color, ROOK);
         // remove king
-        remove_piece(utils::KING_INIT_SQUARES[color], color, KING);
+        remove_piece(castling.king_source[color], color, KING);
         // add rook
         add_piece(utils::rook_castle_target(color, side), color, ROOK);
         // add king
@@ -115,7 +147,6 @@ void Position::make_move(Move move) {
     } else {
         Square src = get_move_source(move);
         Square tgt = get_move_target(move);
-        Bitboard src_mask = bboard::mask_square(src);
         Bitboard tgt_mask = bboard::mask_square(tgt);
         bool is_capture = false;  // used later for 50-move rule
 
@@ -127,13 +158,6 @@ void Position::make_move(Move move) {
             remove_piece(tgt, tgt_sinfo.color, tgt_sinfo.ptype);
 
             cur_state.captured_piece = tgt_sinfo.ptype;
-
-            // remove castling rights for opponent if rook captured
-            if (tgt_sinfo.ptype == ROOK && (tgt_mask & ROOK_FILES &
-                                      (tgt_sinfo.color == WHITE ? RANK_A : RANK_H))) {
-                BoardSide side = (BoardSide)(!utils::sq_file(tgt));
-                castling_rights &= ~utils::to_castling_rights(tgt_sinfo.color, side);
-            }
         }
 
         // remove src piece from its src location
@@ -163,13 +187,8 @@ void Position::make_move(Move move) {
         // place src piece at its new location
         add_piece(tgt, src_sinfo.color, src_sinfo.ptype);
 
-        if (src_sinfo.ptype == KING) {
-            castling_rights &= ~utils::to_castling_rights(src_sinfo.color);
-        } else if ((src_sinfo.ptype == ROOK) && (src_mask & ROOK_FILES)) {
-            // if file is 0, then boardSide is !0 = 1 (queenside) and etc.
-            BoardSide side = (BoardSide)(!utils::sq_file(src));
-            castling_rights &= ~utils::to_castling_rights(src_sinfo.color, side);
-        }
+        // moving the king or a castling rook, or capturing the rook, loses the rights
+        castling_rights &= ~(castling.rights_masks[src] | castling.rights_masks[tgt]);
 
         // for 50-move rule. If is capture or piece is pawn, reset halfmove_clock
         halfmove_clock *= !(is_capture || src_sinfo.ptype == PAWN);
@@ -189,6 +208,9 @@ void Position::make_move(Move move) {
     }
 
     assert(compute_hash() == hash);
+    assert(compute_pawn_hash() == pawn_hash);
+    assert(compute_material_hash() == material_hash);
+    assert(accumulator_good());
 }
 
 void Position::unmake_move(Move move) {
@@ -219,9 +241,9 @@ void Position::unmake_move(Move move) {
         // remove king
         remove_piece(utils::king_castle_target(color, side), color, KING);
         // add rook
-        add_piece(utils::rook_castle_source(color, side), color, ROOK);
+        add_piece(castling.rook_source[color][side], color, ROOK);
         // add king
-        add_piece(utils::KING_INIT_SQUARES[color], color, KING);
+        add_piece(castling.king_source[color], color, KING);
     } else {
         Square src = get_move_source(move);
         Square tgt = get_move_target(move);
@@ -263,6 +285,72 @@ void Position::unmake_move(Move move) {
     hash ^= zobrist::get_black_to_move_key();
 
     assert(compute_hash() == hash);
+    assert(compute_pawn_hash() == pawn_hash);
+    assert(compute_material_hash() == material_hash);
+    assert(accumulator_good());
+}
+
+void Position::restore(const PositionSnapshot& snap) {
+    auto it = pos_counts.find(hash);
+    assert(it != pos_counts.end());
+    it->second--;
+    if (it->second == 0) {
+        pos_counts.erase(it);
+    }
+    assert(history.size() != 0);
+    history.pop();
+
+    // only the squares whose piece changed need their SquareInfo and NNUE features updated
+    Bitboard changed = color_bitboards[WHITE] ^ snap.color_bitboards[WHITE];
+    changed |= color_bitboards[BLACK] ^ snap.color_bitboards[BLACK];
+    for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType)(pt + 1)) {
+        changed |= piece_bitboards[pt] ^ snap.piece_bitboards[pt];
+    }
+    bool nnue_loaded = nnue::is_loaded();
+    if (nnue_loaded) {
+        for (Bitboard bb = changed; bb != 0ULL;) {
+            Square sq = bboard::bitscan_fwd_remove(bb);
+            if (::has_piece(info_board[sq])) {
+                nnue::remove_feature(accumulator, sq, info_board[sq].color, info_board[sq].ptype);
+            }
+        }
+    }
+
+    piece_bitboards = snap.piece_bitboards;
+    color_bitboards = snap.color_bitboards;
+    enpassant_mask = snap.enpassant_mask;
+    hash = snap.hash;
+    pawn_hash = snap.pawn_hash;
+    material_hash = snap.material_hash;
+    halfmove_clock = snap.halfmove_clock;
+    fullmove_number = snap.fullmove_number;
+    side_to_move = (Color) snap.side_to_move;
+    castling_rights = snap.castling_rights;
+    invalidate_caches();
+
+    while (changed != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(changed);
+        Bitboard mask = bboard::mask_square(sq);
+        SquareInfo sinfo = NULL_SQUARE_INFO;
+        if (piece_bitboards[ANY_PIECE] & mask) {
+            sinfo.color = (color_bitboards[WHITE] & mask) ? WHITE : BLACK;
+            for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType)(pt + 1)) {
+                if (piece_bitboards[pt] & mask) {
+                    sinfo.ptype = pt;
+                    break;
+                }
+            }
+            if (nnue_loaded) {
+                nnue::add_feature(accumulator, sq, sinfo.color, sinfo.ptype);
+            }
+        }
+        info_board[sq] = sinfo;
+    }
+
+    assert(compute_hash() == hash);
+    assert(compute_pawn_hash() == pawn_hash);
+    assert(compute_material_hash() == material_hash);
+    assert(accumulator_good());
 }
 
 Bitboard Position::get_attackers(Square target_sq, Color atk_color) const {
@@ -299,52 +387,58 @@ SquareInfo Position::get_piece(Square sq) const {
 }
 
 Bitboard Position::get_attack_mask(Color col) const {
-    Bitboard mask = 0ULL;
+    return get_attacks(col).all;
+}
+
+const AttackInfo& Position::get_attacks(Color c) const {
+    if (!attacks_valid[c]) {
+        compute_attacks(c);
+    }
+    return attack_info[c];
+}
+
+void Position::compute_attacks(Color c) const {
+    AttackInfo& info = attack_info[c];
+    info.n_pieces = 0;
+    info.all = 0ULL;
     // remove king from occ so he doesn't block anything
-    Bitboard occ =
-        get_all_bitboard() & ~get_bitboard(utils::opposite_color(col), KING);
+    Bitboard occ = get_all_bitboard() & ~get_bitboard(utils::opposite_color(c), KING);
 
     // pawns
-    Bitboard pawns = get_bitboard(col, PAWN);
+    Bitboard pawn_attacks = 0ULL;
+    Bitboard pawns = get_bitboard(c, PAWN);
     while (pawns != 0ULL) {
         Square sq = bboard::bitscan_fwd_remove(pawns);
-        mask |= bboard::pawn_attacks(sq, col);
-    }
-
-    // knights
-    Bitboard knights = get_bitboard(col, KNIGHT);
-    while (knights != 0ULL) {
-        Square sq = bboard::bitscan_fwd_remove(knights);
-        mask |= bboard::knight_attacks(sq);
-    }
-
-    // bishops
-    Bitboard bishops = get_bitboard(col, BISHOP);
-    while (bishops != 0ULL) {
-        Square sq = bboard::bitscan_fwd_remove(bishops);
-        mask |= bboard::bishop_attacks(sq, occ);
+        pawn_attacks |= bboard::pawn_attacks(sq, c);
     }
-
-    // rooks
-    Bitboard rooks = get_bitboard(col, ROOK);
-    while (rooks != 0ULL) {
-        Square sq = bboard::bitscan_fwd_remove(rooks);
-        mask |= bboard::rook_attacks(sq, occ);
-    }
-
-    // queens
-    Bitboard queens = get_bitboard(col, QUEEN);
-    while (queens != 0ULL) {
-        Square sq = bboard::bitscan_fwd_remove(queens);
-        mask |= bboard::rook_attacks(sq, occ);
-        mask |= bboard::bishop_attacks(sq, occ);
+    info.by_type[PAWN] = pawn_attacks;
+    info.all |= pawn_attacks;
+
+    for (PieceType pt = KNIGHT; pt <= KING; pt = (PieceType) (pt + 1)) {
+        info.by_type[pt] = 0ULL;
+        Bitboard pieces = get_bitboard(c, pt);
+        while (pieces != 0ULL) {
+            Square sq = bboard::bitscan_fwd_remove(pieces);
+            Bitboard attacks;
+            switch (pt) {
+                case KNIGHT: attacks = bboard::knight_attacks(sq); break;
+                case BISHOP: attacks = bboard::bishop_attacks(sq, occ); break;
+                case ROOK: attacks = bboard::rook_attacks(sq, occ); break;
+                case QUEEN: attacks = bboard::queen_attacks(sq, occ); break;
+                default: attacks = bboard::king_attacks(sq); break;
+            }
+            // only illegal positions have more pieces; they still count towards the unions
+            if (info.n_pieces < 16) {
+                info.squares[info.n_pieces] = sq;
+                info.types[info.n_pieces] = pt;
+                info.attacks[info.n_pieces] = attacks;
+                info.n_pieces++;
+            }
+            info.by_type[pt] |= attacks;
+        }
+        info.all |= info.by_type[pt];
     }
-
-    // king
-    Square king_sq = bboard::bitscan_fwd(get_bitboard(col, KING));
-    mask |= bboard::king_attacks(king_sq);
-
-    return mask;
+    attacks_valid[c] = true;
 }
 
 void Position::add_piece(Square sq, Color c, PieceType piece) {
@@ -354,8 +448,17 @@ void Position::add_piece(Square sq, Color c, PieceType piece) {
     color_bitboards[(int)c] |= mask;
 
     info_board[sq] = SquareInfo{piece, c};
+    invalidate_caches();
     
     hash ^= zobrist::get_key(sq, piece, c);
+    if (piece == PAWN) {
+        pawn_hash ^= zobrist::get_key(sq, PAWN, c);
+    }
+    material_hash ^= zobrist::get_material_key(c, piece, utils::popcount(get_bitboard(c, piece)) - 1);
+
+    if (nnue::is_loaded()) {
+        nnue::add_feature(accumulator, sq, c, piece);
+    }
 }
 
 void Position::remove_piece(Square sq, Color c, PieceType piece) {
@@ -365,14 +468,140 @@ void Position::remove_piece(Square sq, Color c, PieceType piece) {
     color_bitboards[(int)c] &= mask;
 
     info_board[sq] = NULL_SQUARE_INFO;
+    invalidate_caches();
 
     hash ^= zobrist::get_key(sq, piece, c);
+    if (piece == PAWN) {
+        pawn_hash ^= zobrist::get_key(sq, PAWN, c);
+    }
+    material_hash ^= zobrist::get_material_key(c, piece, utils::popcount(get_bitboard(c, piece)));
+
+    if (nnue::is_loaded()) {
+        nnue::remove_feature(accumulator, sq, c, piece);
+    }
 }
 
 bool Position::is_checking() const {
-    Color atk_c = get_side_to_move();
-    Square king_sq = bboard::bitscan_fwd(get_bitboard(atk_c, KING));
-    return get_attackers(king_sq, utils::opposite_color(atk_c)) != 0ULL;
+    return get_checkers() != 0ULL;
+}
+
+Bitboard Position::get_checkers() const {
+    if (!checkers_valid) {
+        Square king_sq = bboard::bitscan_fwd(get_bitboard(side_to_move, KING));
+        checkers = get_attackers(king_sq, utils::opposite_color(side_to_move));
+        checkers_valid = true;
+    }
+    return checkers;
+}
+
+Bitboard Position::get_pinned(Color c) const {
+    if (!pins_valid[c]) {
+        compute_pins(c);
+    }
+    return pinned[c];
+}
+
+Bitboard Position::get_pinners(Color c) const {
+    if (!pins_valid[c]) {
+        compute_pins(c);
+    }
+    return pinners[c];
+}
+
+void Position::compute_pins(Color c) const {
+    pinned[c] = absolute_pins(*this, c, pinners[c]);
+    pins_valid[c] = true;
+}
+
+const CheckInfo& Position::get_check_info() const {
+    if (!check_info_valid) {
+        compute_check_info();
+    }
+    return check_info;
+}
+
+void Position::compute_check_info() const {
+    Color us = side_to_move;
+    Color them = utils::opposite_color(us);
+    Bitboard occ = get_all_bitboard();
+    Bitboard own_occ = get_color_bitboard(us);
+    Square king_sq = bboard::bitscan_fwd(get_bitboard(them, KING));
+
+    CheckInfo& info = check_info;
+    info.king_sq = king_sq;
+    info.check_squares[PAWN] = bboard::pawn_attacks(king_sq, them);
+    info.check_squares[KNIGHT] = bboard::knight_attacks(king_sq);
+    info.check_squares[BISHOP] = bboard::bishop_attacks(king_sq, occ);
+    info.check_squares[ROOK] = bboard::rook_attacks(king_sq, occ);
+    info.check_squares[QUEEN] = info.check_squares[BISHOP] | info.check_squares[ROOK];
+    info.check_squares[KING] = 0ULL;
+
+    // our own pieces shielding the enemy king from our sliders, as in absolute_pins()
+    Bitboard queens = get_bitboard(us, QUEEN);
+    Bitboard snipers = (bboard::rook_xray_attacks(king_sq, occ, own_occ) & (get_bitboard(us, ROOK) | queens)) |
+                       (bboard::bishop_xray_attacks(king_sq, occ, own_occ) & (get_bitboard(us, BISHOP) | queens));
+    info.discoverers = 0ULL;
+    while (snipers != 0ULL) {
+        Square sq = bboard::bitscan_fwd_remove(snipers);
+        info.discoverers |= bboard::blocker(sq, king_sq, occ) & own_occ;
+    }
+    check_info_valid = true;
+}
+
+bool Position::gives_check(Move move) const {
+    const CheckInfo& info = get_check_info();
+    Color us = side_to_move;
+    Bitboard occ = get_all_bitboard();
+    Bitboard king_mask = bboard::mask_square(info.king_sq);
+    MoveType type = get_move_type(move);
+
+    if (type == CASTLING_MOVE) {
+        // only the rook can give check
+        BoardSide side = get_move_castle_side(move);
+        Square rook_tgt = utils::rook_castle_target(us, side);
+        occ &= ~bboard::mask_square(castling.king_source[us]) &
+               ~bboard::mask_square(castling.rook_source[us][side]);
+        occ |= bboard::mask_square(utils::king_castle_target(us, side)) | bboard::mask_square(rook_tgt);
+        return bboard::rook_attacks(rook_tgt, occ) & king_mask;
+    }
+
+    Square src = get_move_source(move);
+    Square tgt = get_move_target(move);
+    Bitboard src_mask = bboard::mask_square(src);
+    Bitboard tgt_mask = bboard::mask_square(tgt);
+
+    // direct check
+    if (type == PROMOTION) {
+        // the pawn leaves src, which may be on the line between tgt and the king
+        Bitboard promo_occ = occ ^ src_mask;
+        Bitboard attacks;
+        switch (get_move_promotion(move)) {
+            case KNIGHT: attacks = bboard::knight_attacks(tgt); break;
+            case BISHOP: attacks = bboard::bishop_attacks(tgt, promo_occ); break;
+            case ROOK: attacks = bboard::rook_attacks(tgt, promo_occ); break;
+            default: attacks = bboard::queen_attacks(tgt, promo_occ); break;
+        }
+        if (attacks & king_mask) {
+            return true;
+        }
+    } else if (info.check_squares[info_board[src].ptype] & tgt_mask) {
+        return true;
+    }
+
+    // discovered check
+    if ((info.discoverers & src_mask) && !utils::aligned(src, tgt, info.king_sq)) {
+        return true;
+    }
+
+    if (type == ENPASSANT) {
+        // the captured pawn may also have shielded the king
+        Color them = utils::opposite_color(us);
+        occ ^= src_mask | tgt_mask | bboard::mask_square(utils::enpassant_actual(tgt, them));
+        Bitboard queens = get_bitboard(us, QUEEN);
+        return (bboard::rook_attacks(info.king_sq, occ) & (get_bitboard(us, ROOK) | queens)) ||
+               (bboard::bishop_attacks(info.king_sq, occ) & (get_bitboard(us, BISHOP) | queens));
+    }
+    return false;
 }
 
 bool Position::is_won_slow() const {
@@ -425,7 +654,60 @@ void Position::clear() {
     fullmove_number = 1;
     history = {};
     hash = 0;
+    pawn_hash = 0;
+    material_hash = 0;
     info_board.fill(NULL_SQUARE_INFO);
+    set_standard_castling();
+    invalidate_caches();
+    if (nnue::is_loaded()) {
+        nnue::reset(accumulator);
+    }
+}
+
+void Position::set_standard_castling() {
+    castling.rights_masks = {};
+    for (Color c : {WHITE, BLACK}) {
+        for (BoardSide side : {KINGSIDE, QUEENSIDE}) {
+            set_castling_squares(c, side, utils::KING_INIT_SQUARES[c], utils::rook_castle_source(c, side));
+        }
+    }
+    castling.standard = true;
+}
+
+void Position::set_castling_squares(Color c, BoardSide side, Square king_sq, Square rook_sq) {
+    // squares from a to b on the back rank, both included
+    auto span = [](Square a, Square b) {
+        Square lo = std::min(a, b);
+        Square hi = std::max(a, b);
+        return (2ULL << hi) - (1ULL << lo);
+    };
+    Square king_tgt = utils::king_castle_target(c, side);
+    Square rook_tgt = utils::rook_castle_target(c, side);
+    Bitboard king_rook = bboard::mask_square(king_sq) | bboard::mask_square(rook_sq);
+
+    castling.king_source[c] = king_sq;
+    castling.rook_source[c][side] = rook_sq;
+    castling.king_path[c][side] = span(king_sq, king_tgt) & ~bboard::mask_square(king_sq);
+    castling.between[c][side] = (span(king_sq, king_tgt) | span(rook_sq, rook_tgt)) & ~king_rook;
+    castling.rights_masks[king_sq] |= utils::to_castling_rights(c);
+    castling.rights_masks[rook_sq] |= utils::to_castling_rights(c, side);
+    castling.standard &= king_sq == utils::KING_INIT_SQUARES[c] &&
+                         rook_sq == utils::rook_castle_source(c, side);
+}
+
+void Position::refresh_accumulator() {
+    if (nnue::is_loaded()) {
+        compute_accumulator(*this, accumulator);
+    }
+}
+
+bool Position::accumulator_good() const {
+    if (!nnue::is_loaded()) {
+        return true;
+    }
+    nnue::Accumulator fresh;
+    compute_accumulator(*this, fresh);
+    return std::memcmp(&fresh, &accumulator, sizeof(fresh)) == 0;
 }
 
 ZobristKey Position::compute_hash() {
@@ -448,6 +730,31 @@ ZobristKey Position::compute_hash() {
     return hs;
 }
 
+ZobristKey Position::compute_material_hash() {
+    ZobristKey hs{};
+    for (Color c : {WHITE, BLACK}) {
+        for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType)(pt + 1)) {
+            int count = utils::popcount(get_bitboard(c, pt));
+            for (int n = 0; n < count; n++) {
+                hs ^= zobrist::get_material_key(c, pt, n);
+            }
+        }
+    }
+    return hs;
+}
+
+ZobristKey Position::compute_pawn_hash() {
+    ZobristKey hs{};
+    for (Color c : {WHITE, BLACK}) {
+        Bitboard bb = get_bitboard(c, PAWN);
+        while (bb) {
+            Square sq = bboard::bitscan_fwd_remove(bb);
+            hs ^= zobrist::get_key(sq, PAWN, c);
+        }
+    }
+    return hs;
+}
+
 #include <iostream>
 void test_get_attackers(Position& pos, Square sq, Color atk_color) {
     Bitboard attackers = pos.get_attackers(sq, atk_color);
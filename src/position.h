@@ -7,6 +7,7 @@
 #include <unordered_map>
 
 #include "bitboard.h"
+#include "nnue.h"
 
 struct PosState {
     PieceType captured_piece;
@@ -22,8 +23,62 @@ struct SquareInfo {
 
 constexpr SquareInfo NULL_SQUARE_INFO{NO_PIECE, N_COLORS};
 
+// Attack sets of one color's pieces, computed in a single pass over the pieces. Sliders see
+// through the enemy king, as in Position::get_attack_mask().
+struct AttackInfo {
+    // attacks of each non-pawn piece; at most 16 with promotions
+    int n_pieces;
+    Square squares[16];
+    PieceType types[16];
+    Bitboard attacks[16];
+    // union of the attacks of each piece type, including pawns
+    Bitboard by_type[N_REAL_PIECE_TYPES];
+    Bitboard all;
+};
+
+// What a move of the side to move needs to give check, computed once per node
+struct CheckInfo {
+    // squares from which each piece type of the side to move attacks the enemy king
+    Bitboard check_squares[N_REAL_PIECE_TYPES];
+    // pieces of the side to move whose leaving the line gives a discovered check
+    Bitboard discoverers;
+    Square king_sq;  // the enemy king
+};
+
+// The squares castling moves the king and the rooks from, and the masks checked before castling.
+// Fixed for a game and set from the FEN; arbitrary king and rook files are allowed for Chess960.
+struct CastlingInfo {
+    Square king_source[N_COLORS];
+    Square rook_source[N_COLORS][N_BOARD_SIDES];
+    // squares the king crosses up to its target, which must not be attacked
+    Bitboard king_path[N_COLORS][N_BOARD_SIDES];
+    // squares that must be empty, not counting the castling king and rook
+    Bitboard between[N_COLORS][N_BOARD_SIDES];
+    // castling rights lost by a move from or to each square
+    std::array<CastlingRights, 64> rights_masks;
+    // whether all the squares are those of standard chess
+    bool standard;
+};
+
 inline bool has_piece(const SquareInfo& sinfo) { return sinfo.ptype != NO_PIECE; }
 
+// Compact, trivially copyable copy of the board state of a Position, about 100 bytes. It leaves
+// out what can be rebuilt from it, i.e. the square-indexed board and the NNUE accumulator, and the
+// repetition counts. Used for copy-make: taking a snapshot before make_move() and restoring it
+// afterwards replaces unmake_move().
+struct PositionSnapshot {
+    std::array<Bitboard, N_PIECE_TYPES - 1> piece_bitboards;  // excludes NO_PIECE
+    std::array<Bitboard, N_COLORS> color_bitboards;
+    Bitboard enpassant_mask;
+    ZobristKey hash;
+    ZobristKey pawn_hash;
+    ZobristKey material_hash;
+    int16_t halfmove_clock;
+    int16_t fullmove_number;
+    uint8_t side_to_move;
+    CastlingRights castling_rights;
+};
+
 class Position {
    public:
     // initialize to starting position
@@ -72,10 +127,50 @@ class Position {
         return castling_rights;
     }
 
+    inline Square get_castling_king_source(Color c) const {
+        return castling.king_source[c];
+    }
+
+    inline Square get_castling_rook_source(Color c, BoardSide side) const {
+        return castling.rook_source[c][side];
+    }
+
+    inline Bitboard get_castling_king_path(Color c, BoardSide side) const {
+        return castling.king_path[c][side];
+    }
+
+    inline Bitboard get_castling_between(Color c, BoardSide side) const {
+        return castling.between[c][side];
+    }
+
+    // whether the kings and rooks castle from the standard squares
+    inline bool has_standard_castling() const {
+        return castling.standard;
+    }
+
+    // whether castling moves are written as the king capturing its rook, as UCI_Chess960 asks
+    inline bool is_chess960() const {
+        return chess960;
+    }
+
+    inline void set_chess960(bool value) {
+        chess960 = value;
+    }
+
     void make_move(Move);
 
     void unmake_move(Move);
 
+    inline PositionSnapshot snapshot() const {
+        return PositionSnapshot{piece_bitboards, color_bitboards, enpassant_mask, hash, pawn_hash,
+                                material_hash, (int16_t) halfmove_clock, (int16_t) fullmove_number,
+                                (uint8_t) side_to_move, castling_rights};
+    }
+
+    // undo the last make_move() by restoring the snapshot taken right before it; an alternative to
+    // unmake_move() that does not depend on the move
+    void restore(const PositionSnapshot& snap);
+
     // std::string to_ascii() const;
 
     // std::string serialize() const;
@@ -110,6 +205,12 @@ class Position {
     */
     Bitboard get_attack_mask(Color c) const;
 
+    /*
+    Return the per-piece attack sets of c. They are computed on first use after the pieces
+    change and cached, so movegen and the evaluation of the same node share them.
+    */
+    const AttackInfo& get_attacks(Color c) const;
+
     inline Color get_side_to_move() const { return side_to_move; }
 
     inline Bitboard get_enpassant() const { return enpassant_mask; };
@@ -151,6 +252,27 @@ class Position {
     // returns whether king of the side to move is in check
     bool is_checking() const;
 
+    /*
+    Return the pieces checking the king of the side to move. Computed on first use after the
+    pieces change and cached, so movegen, the search and the evaluation of the same node share it.
+    */
+    Bitboard get_checkers() const;
+
+    // pieces of c pinned to c's king, as in absolute_pins(); cached like get_checkers()
+    Bitboard get_pinned(Color c) const;
+
+    // enemy sliders pinning the pieces of get_pinned(c)
+    Bitboard get_pinners(Color c) const;
+
+    // returns whether the legal move would check the enemy king, without making it
+    bool gives_check(Move move) const;
+
+    /*
+    Return the check squares and discovered check candidates of the side to move. Cached like
+    get_attacks().
+    */
+    const CheckInfo& get_check_info() const;
+
     /*
     These functions are used for convenience only. For efficiency, the engine should use 
     the result from gen_legal_moves().
@@ -194,6 +316,18 @@ class Position {
 
     inline ZobristKey get_hash() const { return hash; }
 
+    // hash of the pawns only; used to index the pawn structure table
+    inline ZobristKey get_pawn_hash() const { return pawn_hash; }
+
+    // hash of the piece counts of both colors; used to index the material table
+    inline ZobristKey get_material_hash() const { return material_hash; }
+
+    // NNUE first-layer accumulator; only maintained while a network is loaded
+    inline const nnue::Accumulator& get_accumulator() const { return accumulator; }
+
+    // recompute the accumulator from scratch, e.g. after a network is loaded
+    void refresh_accumulator();
+
    private:
     Color side_to_move;
     CastlingRights castling_rights;
@@ -214,15 +348,70 @@ class Position {
 	// incrementally updated zobrist hash
     ZobristKey hash;
 
+    // incrementally updated zobrist hash of the pawns of both colors
+    ZobristKey pawn_hash;
+
+    // incrementally updated zobrist hash of the piece counts
+    ZobristKey material_hash;
+
     std::unordered_map<ZobristKey, unsigned> pos_counts;
 
+    CastlingInfo castling;
+    bool chess960 = false;
+
     std::array<SquareInfo, 64> info_board;
 
+    nnue::Accumulator accumulator;
+
+    // cache for get_attacks(); not copied
+    mutable std::array<AttackInfo, N_COLORS> attack_info;
+    mutable std::array<bool, N_COLORS> attacks_valid{};
+
+    // cache for get_check_info(); invalidated together with attack_info
+    mutable CheckInfo check_info;
+    mutable bool check_info_valid = false;
+
+    // caches for get_checkers(), get_pinned() and get_pinners()
+    mutable Bitboard checkers;
+    mutable bool checkers_valid = false;
+    mutable std::array<Bitboard, N_COLORS> pinned;
+    mutable std::array<Bitboard, N_COLORS> pinners;
+    mutable std::array<bool, N_COLORS> pins_valid{};
+
+    // drop every cached value derived from the pieces
+    inline void invalidate_caches() {
+        attacks_valid = {};
+        check_info_valid = false;
+        checkers_valid = false;
+        pins_valid = {};
+    }
+
+    void compute_attacks(Color c) const;
+
+    void compute_check_info() const;
+
+    void compute_pins(Color c) const;
+
     // clear all pieces and state
     void clear();
 
+    // castle from the standard squares
+    void set_standard_castling();
+
+    // let c castle to side with the king on king_sq and the rook on rook_sq
+    void set_castling_squares(Color c, BoardSide side, Square king_sq, Square rook_sq);
+
 	// re-calculate the hash
     ZobristKey compute_hash();
+
+    // re-calculate the pawn hash
+    ZobristKey compute_pawn_hash();
+
+    // re-calculate the material hash
+    ZobristKey compute_material_hash();
+
+    // whether the incrementally updated accumulator matches a full refresh
+    bool accumulator_good() const;
 };
 
 void test_get_attackers(Position& pos, Square sq, Color atk_color);
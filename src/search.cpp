@@ -7,6 +7,15 @@
 #include "movegen.h"
 #include "logger.h"
 
+const SearchParamSpec SEARCH_PARAM_SPECS[] = {
+    {"NodeCheckInterval", &SearchParams::node_check_interval, 256, 16384, 512},
+    {"TimeFactor", &SearchParams::time_factor_pct, 20, 100, 5},
+    {"StartDepth", &SearchParams::start_depth, 1, 8, 1},
+    {"MovesHorizon", &SearchParams::moves_horizon, 10, 100, 5},
+    {"MaxCheckExtensions", &SearchParams::max_check_extensions, 0, 16, 1},
+};
+const int N_SEARCH_PARAMS = sizeof(SEARCH_PARAM_SPECS) / sizeof(SEARCH_PARAM_SPECS[0]);
+
 // TODO refactor delete this file
 #if 0
 namespace {
@@ -26,6 +26,33 @@ struct SearchLimit {
     int depth;
 };
 
+// Search constants that can be set with setoption and tuned with SPSA (see spsa.h).
+struct SearchParams {
+    // check the time limit every this many nodes
+    int node_check_interval = 2048;
+    // do not start another iteration after this percentage of the allocated time has passed
+    int time_factor_pct = 60;
+    // first depth of iterative deepening
+    int start_depth = 4;
+    // expected game length in moves for time allocation (Cray Blitz)
+    int moves_horizon = 45;
+    // most plies a path can be extended by for checking moves
+    int max_check_extensions = 4;
+};
+
+// Description of one tunable SearchParams field, as shown in the UCI options.
+struct SearchParamSpec {
+    const char* name;
+    int SearchParams::*field;
+    int min;
+    int max;
+    // SPSA perturbation size at the end of tuning
+    int spsa_step;
+};
+
+extern const SearchParamSpec SEARCH_PARAM_SPECS[];
+extern const int N_SEARCH_PARAMS;
+
 struct SearchMetrics {
     int depth;
     int nodes;
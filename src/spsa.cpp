@@ -0,0 +1,213 @@
+#include "spsa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "hash.h"
+#include "movegen.h"
+#include "threading.h"
+#include "utils.h"
+
+namespace {
+
+// transposition table entries per engine
+constexpr size_t ENGINE_TT_SZ = 1 << 16;
+// games longer than this are adjudicated as draws
+constexpr int MAX_GAME_PLIES = 400;
+
+// standard SPSA exponents
+constexpr double ALPHA = 0.602;
+constexpr double GAMMA = 0.101;
+
+class Engine {
+   public:
+    Engine() : table(ENGINE_TT_SZ) {
+        thread.set_table(&table);
+        thread.set_silent(true);
+    }
+
+    void new_game(const SearchParams& params) {
+        table = ht::Table(ENGINE_TT_SZ);
+        thread.set_search_params(params);
+    }
+
+    Move search(const Position& pos, SearchLimit limit) {
+        thread.set_position(pos);
+        thread.reset();
+        thread.set_search_limit(limit);
+        thread.start_search();
+        thread.wait_for_search();
+        return thread.get_state().best_move;
+    }
+
+   private:
+    ht::Table table;
+    thread::Thread thread;
+};
+
+// one pair of engines per concurrent game
+struct Worker {
+    Engine plus;
+    Engine minus;
+    double score;  // wins minus losses of the plus engine
+};
+
+// play a game and return the result from white's point of view: 1, 0.5 or 0
+double play_game(Engine& white, Engine& black, const Position& opening, const spsa::Config& config) {
+    Position pos = opening;
+    int clock[N_COLORS] = {config.base_time, config.base_time};
+    for (int ply = 0; ply < MAX_GAME_PLIES; ply++) {
+        Color side2move = pos.get_side_to_move();
+        std::vector<Move> moves;
+        bool checking = gen_legal_moves(pos, moves);
+        if (moves.empty()) {
+            return checking ? (side2move == WHITE ? 0. : 1.) : 0.5;
+        }
+        if (pos.is_drawn_by_50() || pos.is_drawn_by_threefold()) {
+            return 0.5;
+        }
+
+        SearchLimit limit = {};
+        limit.tc = TimeControlParams{clock[WHITE], clock[BLACK], config.increment, config.increment};
+        utils::Timer timer;
+        Move move = (side2move == WHITE ? white : black).search(pos, limit);
+        clock[side2move] -= (int) timer.elapsed_millis();
+        if (clock[side2move] < 0) {
+            // lost on time
+            return side2move == WHITE ? 0. : 1.;
+        }
+        clock[side2move] += config.increment;
+        pos.make_move(move);
+    }
+    return 0.5;
+}
+
+Position random_opening(utils::PRNG& prng, int plies) {
+    while (true) {
+        Position pos;
+        bool good = true;
+        for (int ply = 0; ply < plies && good; ply++) {
+            std::vector<Move> moves;
+            gen_legal_moves(pos, moves);
+            if (moves.empty()) {
+                good = false;
+                break;
+            }
+            pos.make_move(moves[prng.rand64() % moves.size()]);
+        }
+        std::vector<Move> moves;
+        gen_legal_moves(pos, moves);
+        if (good && !moves.empty()) {
+            return pos;
+        }
+    }
+}
+
+SearchParams to_params(const std::vector<double>& theta) {
+    SearchParams params;
+    for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+        const SearchParamSpec& spec = SEARCH_PARAM_SPECS[i];
+        params.*spec.field = std::clamp((int) std::lround(theta[i]), spec.min, spec.max);
+    }
+    return params;
+}
+
+void print_params(const char* prefix, const SearchParams& params) {
+    std::cout << "info string " << prefix;
+    for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+        std::cout << " " << SEARCH_PARAM_SPECS[i].name << " " << params.*SEARCH_PARAM_SPECS[i].field;
+    }
+    std::cout << std::endl;
+}
+}  // namespace
+
+SearchParams spsa::tune(const SearchParams& start, const Config& config) {
+    int n_threads = config.threads > 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < n_threads; t++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    // gains, per parameter
+    const double big_a = 0.1 * config.iterations;
+    std::vector<double> theta(N_SEARCH_PARAMS);
+    std::vector<double> a(N_SEARCH_PARAMS);
+    std::vector<double> c(N_SEARCH_PARAMS);
+    for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+        const SearchParamSpec& spec = SEARCH_PARAM_SPECS[i];
+        theta[i] = start.*spec.field;
+        double a_end = config.learning_rate * spec.spsa_step * spec.spsa_step;
+        a[i] = a_end * std::pow(big_a + config.iterations, ALPHA);
+        c[i] = spec.spsa_step * std::pow(config.iterations, GAMMA);
+    }
+
+    utils::PRNG prng(config.seed);
+    for (int k = 0; k < config.iterations; k++) {
+        std::vector<double> ck(N_SEARCH_PARAMS);
+        std::vector<int> delta(N_SEARCH_PARAMS);
+        std::vector<double> theta_plus(N_SEARCH_PARAMS);
+        std::vector<double> theta_minus(N_SEARCH_PARAMS);
+        for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+            ck[i] = c[i] / std::pow(k + 1, GAMMA);
+            delta[i] = (prng.rand64() & 1) ? 1 : -1;
+            theta_plus[i] = theta[i] + ck[i] * delta[i];
+            theta_minus[i] = theta[i] - ck[i] * delta[i];
+        }
+        const SearchParams plus = to_params(theta_plus);
+        const SearchParams minus = to_params(theta_minus);
+
+        // openings are drawn up front so that results do not depend on scheduling
+        std::vector<Position> openings;
+        for (int g = 0; g < config.game_pairs; g++) {
+            openings.push_back(random_opening(prng, config.opening_plies));
+        }
+
+        std::atomic<int> next_pair(0);
+        std::vector<std::thread> game_threads;
+        for (auto& worker : workers) {
+            worker->score = 0;
+            game_threads.emplace_back([&, w = worker.get()] {
+                for (int g = next_pair++; g < config.game_pairs; g = next_pair++) {
+                    w->plus.new_game(plus);
+                    w->minus.new_game(minus);
+                    double first = play_game(w->plus, w->minus, openings[g], config);
+                    w->plus.new_game(plus);
+                    w->minus.new_game(minus);
+                    double second = 1. - play_game(w->minus, w->plus, openings[g], config);
+                    w->score += 2. * (first - 0.5) + 2. * (second - 0.5);
+                }
+            });
+        }
+        for (auto& game_thread : game_threads) {
+            game_thread.join();
+        }
+
+        double score = 0;
+        for (auto& worker : workers) {
+            score += worker->score;
+        }
+
+        for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+            const SearchParamSpec& spec = SEARCH_PARAM_SPECS[i];
+            double ak = a[i] / std::pow(big_a + k + 1, ALPHA);
+            theta[i] += ak / ck[i] * score * delta[i];
+            theta[i] = std::clamp(theta[i], (double) spec.min, (double) spec.max);
+        }
+
+        std::cout << "info string spsa iteration " << k + 1 << "/" << config.iterations
+                  << " score " << score;
+        for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+            std::cout << " " << SEARCH_PARAM_SPECS[i].name << " " << theta[i];
+        }
+        std::cout << std::endl;
+    }
+
+    SearchParams tuned = to_params(theta);
+    print_params("spsa result", tuned);
+    return tuned;
+}
@@ -0,0 +1,41 @@
+#pragma once
+/*
+ * SPSA tuning of the search constants in SearchParams by in-process self-play.
+ *
+ * Each iteration perturbs all parameters at once by +-c_k in a random direction, plays game pairs
+ * (each random opening once with each color) between an engine using the "plus" parameters and
+ * one using the "minus" parameters, and moves the parameters along the direction in proportion
+ * to the score difference. Gains follow the Fishtest conventions: c_k decays to each parameter's
+ * spsa_step, and the learning rate is r_end = a_end / c_end^2.
+ *
+ * Games are played concurrently, one pair of engines per core. Every engine is a silent
+ * thread::Thread with its own small transposition table, so games do not interfere.
+ */
+
+#include <cstdint>
+
+#include "search.h"
+
+namespace spsa {
+
+struct Config {
+    int iterations = 100;
+    // game pairs per iteration
+    int game_pairs = 8;
+    // clock per side and increment, in milliseconds
+    int base_time = 2000;
+    int increment = 20;
+    // number of concurrent games; 0 for one per core
+    int threads = 0;
+    // r_end in Fishtest terms
+    double learning_rate = 0.002;
+    // random plies played from the starting position to diversify openings
+    int opening_plies = 8;
+    uint64_t seed = 1;
+};
+
+// Tune start with self-play games and return the tuned values. Progress is printed as UCI info
+// strings.
+SearchParams tune(const SearchParams& start, const Config& config);
+
+}  // namespace spsa
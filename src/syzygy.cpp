@@ -0,0 +1,1095 @@
+#include "syzygy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "bitboard.h"
+#include "hash.h"
+#include "logger.h"
+#include "movegen.h"
+#include "utils.h"
+
+using namespace syzygy;
+
+namespace {
+
+constexpr int TB_PIECES = 7;
+
+enum TBType { TB_WDL, TB_DTZ };
+
+// flags of a PairsData
+enum TBFlag {
+    FLAG_STM = 1,
+    FLAG_MAPPED = 2,
+    FLAG_WIN_PLIES = 4,
+    FLAG_LOSS_PLIES = 8,
+    FLAG_WIDE = 16,
+    FLAG_SINGLE_VALUE = 128
+};
+
+constexpr uint8_t WDL_MAGIC[4] = {0x71, 0xE8, 0x23, 0x5D};
+constexpr uint8_t DTZ_MAGIC[4] = {0xD7, 0x66, 0x0C, 0xA5};
+
+#ifdef _WIN32
+constexpr char PATH_SEPARATOR = ';';
+#else
+constexpr char PATH_SEPARATOR = ':';
+#endif
+
+/* table files are little-endian, except for the Huffman-coded blocks */
+
+inline uint16_t read_le16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t read_le32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+inline uint32_t read_be32(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+inline uint64_t read_be64(const uint8_t* p) {
+    return ((uint64_t) read_be32(p) << 32) | read_be32(p + 4);
+}
+
+// piece codes in table files: 1-6 for a white pawn to king, 9-14 for black
+inline int tb_piece(Color c, PieceType pt) {
+    return (pt + 1) | (c == BLACK ? 8 : 0);
+}
+
+inline int off_a1h8(int sq) {
+    return utils::sq_rank(Square(sq)) - utils::sq_file(Square(sq));
+}
+
+// symbols are 12 bits
+using Sym = uint16_t;
+
+// a node of the recursive pairing tree: the left and right symbols, 12 bits each
+struct LR {
+    uint8_t lr[3];
+
+    Sym left() const { return ((lr[1] & 0xF) << 8) | lr[0]; }
+    Sym right() const { return (lr[2] << 4) | (lr[1] >> 4); }
+};
+static_assert(sizeof(LR) == 3, "LR must be packed");
+
+// the value at index k * span + span / 2 is at position offset of block
+struct SparseEntry {
+    uint8_t block[4];
+    uint8_t offset[2];
+};
+static_assert(sizeof(SparseEntry) == 6, "SparseEntry must be packed");
+
+// compressed data of one table for one side to move and, with pawns, one leading pawn file
+struct PairsData {
+    uint8_t flags;
+    size_t sizeof_block;
+    size_t span;
+    uint32_t num_blocks;
+    int max_sym_len;
+    int min_sym_len;
+    const uint8_t* lowest_sym;  // uint16[]
+    const LR* btree;
+    const uint8_t* block_length;  // uint16[]
+    size_t block_length_size;
+    const SparseEntry* sparse_index;
+    size_t sparse_index_size;
+    const uint8_t* data;
+    std::vector<uint64_t> base64;
+    std::vector<uint8_t> symlen;
+    // the order of the pieces in the encoding, as tablebase piece codes
+    int pieces[TB_PIECES];
+    // number of pieces per group, zero-terminated, and the index multiplier of each group
+    int group_len[TB_PIECES + 1];
+    uint64_t group_idx[TB_PIECES + 1];
+    // DTZ only: offsets into TBTable::map of the value maps per result
+    uint16_t map_idx[4];
+};
+
+struct TBTable {
+    TBType type;
+    // file name without the extension, e.g. "KRvK"
+    std::string code;
+    // material hash with the first side of the code as white, resp. black
+    ZobristKey key;
+    ZobristKey key2;
+    int piece_count;
+    bool has_pawns;
+    bool has_unique_pieces;
+    // pawns of the leading color and of the other color
+    int pawn_count[2];
+
+    // whether mapping has been attempted; file is closed if it failed
+    std::atomic<bool> ready{false};
+    utils::MappedFile file;
+    const uint8_t* end = nullptr;
+    // DTZ only
+    const uint8_t* map = nullptr;
+
+    // [side to move][leading pawn file]; DTZ tables have one side to move only
+    PairsData items[2][4];
+
+    PairsData* get(int stm, int file) {
+        return &items[type == TB_WDL ? stm % 2 : 0][has_pawns ? file : 0];
+    }
+};
+
+/* encoding tables */
+
+// maps squares below the a1-h8 diagonal to 0..27
+int map_b1h1h7[64];
+// maps squares in the a1-d1-d4 triangle to 0..9
+int map_a1d1d4[64];
+// maps the 462 legal placements of two kings, the first in the a1-d1-d4 triangle
+int map_kk[10][64];
+// binomial[k][n]: ways to choose k of n elements
+uint64_t binomial[6][64];
+// pawn squares a2-h7 to 0..47; higher values are closer to the edge and to rank 2
+int map_pawns[64];
+int lead_pawn_idx[6][64];
+int lead_pawns_size[6][4];
+
+std::deque<TBTable> wdl_tables;
+std::deque<TBTable> dtz_tables;
+// material hash -> WDL and DTZ tables
+std::unordered_map<ZobristKey, std::pair<TBTable*, TBTable*>> registry;
+std::vector<std::string> directories;
+int max_cardinality = 0;
+std::mutex map_mutex;
+
+void init_indices() {
+    static bool done = false;
+    if (done) {
+        return;
+    }
+    done = true;
+
+    int code = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (off_a1h8(sq) < 0) {
+            map_b1h1h7[sq] = code++;
+        }
+    }
+
+    std::vector<int> diagonal;
+    code = 0;
+    for (int sq = 0; sq <= SQ_D4; sq++) {
+        if (off_a1h8(sq) < 0 && utils::sq_file(Square(sq)) <= 3) {
+            map_a1d1d4[sq] = code++;
+        } else if (!off_a1h8(sq) && utils::sq_file(Square(sq)) <= 3) {
+            diagonal.push_back(sq);
+        }
+    }
+    // diagonal squares are encoded last
+    for (int sq : diagonal) {
+        map_a1d1d4[sq] = code++;
+    }
+
+    // if the first king is on the a1-d4 diagonal, the other one is not above the a1-h8 diagonal
+    std::vector<std::pair<int, int>> both_on_diagonal;
+    code = 0;
+    for (int idx = 0; idx < 10; idx++) {
+        for (int s1 = 0; s1 <= SQ_D4; s1++) {
+            // b1 is mapped to 0
+            if (map_a1d1d4[s1] != idx || (!idx && s1 != SQ_B1)) {
+                continue;
+            }
+            for (int s2 = 0; s2 < 64; s2++) {
+                if ((bboard::king_attacks(Square(s1)) | bboard::mask_square(Square(s1))) &
+                    bboard::mask_square(Square(s2))) {
+                    continue;  // illegal
+                } else if (!off_a1h8(s1) && off_a1h8(s2) > 0) {
+                    continue;  // first on the diagonal, second above
+                } else if (!off_a1h8(s1) && !off_a1h8(s2)) {
+                    both_on_diagonal.emplace_back(idx, s2);
+                } else {
+                    map_kk[idx][s2] = code++;
+                }
+            }
+        }
+    }
+    for (auto& p : both_on_diagonal) {
+        map_kk[p.first][p.second] = code++;
+    }
+
+    binomial[0][0] = 1;
+    for (int n = 1; n < 64; n++) {
+        for (int k = 0; k < 6 && k <= n; k++) {
+            binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+        }
+    }
+
+    // with 7 pieces, up to 5 pawns can lead
+    int available = 47;
+    for (int lead_cnt = 1; lead_cnt <= 5; lead_cnt++) {
+        for (int file = 0; file < 4; file++) {
+            // tables are split by the file of the leading pawn, so the index restarts per file
+            int idx = 0;
+            for (int rank = 1; rank <= 6; rank++) {
+                int sq = utils::make_square(rank, file);
+                if (lead_cnt == 1) {
+                    map_pawns[sq] = available--;
+                    map_pawns[sq ^ 7] = available--;
+                }
+                lead_pawn_idx[lead_cnt][sq] = idx;
+                idx += binomial[lead_cnt - 1][map_pawns[sq]];
+            }
+            lead_pawns_size[lead_cnt][file] = idx;
+        }
+    }
+}
+
+bool pawns_comp(int a, int b) {
+    return map_pawns[a] < map_pawns[b];
+}
+
+// Map the first file named name in the tablebase directories. Return a pointer past the magic
+// number, or null if there is no such file or it is corrupted.
+const uint8_t* map_file(TBTable& e, const std::string& name) {
+    for (const std::string& dir : directories) {
+        if (e.file.open(dir + "/" + name)) {
+            break;
+        }
+    }
+    if (!e.file.is_open()) {
+        return nullptr;
+    }
+
+    // table files are a 16-byte header followed by 64-byte aligned data
+    if (e.file.size() % 64 != 16 || std::memcmp(e.file.data(), e.type == TB_WDL ? WDL_MAGIC : DTZ_MAGIC, 4)) {
+        LOG(logERROR) << "Corrupted tablebase file '" << name << "'";
+        e.file.close();
+        return nullptr;
+    }
+    e.end = e.file.data() + e.file.size();
+    return e.file.data() + 4;
+}
+
+/* table layout */
+
+// number of values a symbol expands to, minus one
+uint8_t set_symlen(PairsData* d, Sym s, std::vector<bool>& visited) {
+    visited[s] = true;  // the tree is acyclic
+    Sym sr = d->btree[s].right();
+    if (sr == 0xFFF) {
+        return 0;
+    }
+    Sym sl = d->btree[s].left();
+    if (!visited[sl]) {
+        d->symlen[sl] = set_symlen(d, sl, visited);
+    }
+    if (!visited[sr]) {
+        d->symlen[sr] = set_symlen(d, sr, visited);
+    }
+    return d->symlen[sl] + d->symlen[sr] + 1;
+}
+
+const uint8_t* set_sizes(PairsData* d, const uint8_t* data) {
+    d->flags = *data++;
+
+    if (d->flags & FLAG_SINGLE_VALUE) {
+        d->num_blocks = 0;
+        d->span = 0;
+        d->sparse_index_size = 0;
+        d->block_length_size = 0;
+        d->sizeof_block = 0;
+        // the single value is stored here
+        d->min_sym_len = *data++;
+        return data;
+    }
+
+    // the last group index is the size of the table
+    uint64_t tb_size = d->group_idx[std::find(d->group_len, d->group_len + TB_PIECES, 0) - d->group_len];
+
+    d->sizeof_block = 1ULL << *data++;
+    d->span = 1ULL << *data++;
+    d->sparse_index_size = (tb_size + d->span - 1) / d->span;
+    int padding = *data++;
+    d->num_blocks = read_le32(data);
+    data += 4;
+    // padded so that the sparse index does not point out of range
+    d->block_length_size = d->num_blocks + padding;
+    d->max_sym_len = *data++;
+    d->min_sym_len = *data++;
+    d->lowest_sym = data;
+    d->base64.assign(d->max_sym_len - d->min_sym_len + 1, 0);
+
+    // Canonical Huffman code: longer symbols have lower values. base64[i] is the lowest code of
+    // length i + min_sym_len, left-aligned in 64 bits, so that base64[i] >= base64[i + 1].
+    for (int i = (int) d->base64.size() - 2; i >= 0; i--) {
+        d->base64[i] = (d->base64[i + 1] + read_le16(d->lowest_sym + 2 * i) -
+                        read_le16(d->lowest_sym + 2 * (i + 1))) / 2;
+    }
+    for (size_t i = 0; i < d->base64.size(); i++) {
+        d->base64[i] <<= 64 - i - d->min_sym_len;
+    }
+
+    data += d->base64.size() * sizeof(Sym);
+    d->symlen.assign(read_le16(data), 0);
+    data += sizeof(uint16_t);
+    d->btree = (const LR*) data;
+
+    // the compression is recursive pairing: each symbol is a value or a pair of symbols
+    std::vector<bool> visited(d->symlen.size());
+    for (Sym sym = 0; sym < d->symlen.size(); sym++) {
+        if (!visited[sym]) {
+            d->symlen[sym] = set_symlen(d, sym, visited);
+        }
+    }
+
+    return data + d->symlen.size() * sizeof(LR) + (d->symlen.size() & 1);
+}
+
+const uint8_t* set_dtz_map(TBTable& e, const uint8_t* data, int max_file) {
+    e.map = data;
+    for (int f = 0; f <= max_file; f++) {
+        PairsData* d = e.get(0, f);
+        if (!(d->flags & FLAG_MAPPED)) {
+            continue;
+        }
+        if (d->flags & FLAG_WIDE) {
+            data += (uintptr_t) data & 1;  // word alignment
+            for (int i = 0; i < 4; i++) {
+                d->map_idx[i] = (uint16_t) ((data - e.map) / 2 + 1);
+                data += 2 * read_le16(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d->map_idx[i] = (uint16_t) (data - e.map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((uintptr_t) data & 1);
+}
+
+// split the pieces into groups that are encoded together and compute the index multipliers
+void set_groups(TBTable& e, PairsData* d, const int order[2], int file) {
+    int n = 0;
+    int first_len = e.has_pawns ? 0 : e.has_unique_pieces ? 3 : 2;
+    d->group_len[n] = 1;
+
+    // the leading group, then one group per run of identical pieces
+    for (int i = 1; i < e.piece_count; i++) {
+        if (--first_len > 0 || d->pieces[i] == d->pieces[i - 1]) {
+            d->group_len[n]++;
+        } else {
+            d->group_len[++n] = 1;
+        }
+    }
+    d->group_len[++n] = 0;
+
+    // The groups are encoded as g1 * N(g2) * N(g3) + g2 * N(g3) + g3, where N(g) is the number
+    // of placements of g, but in a per-table order: the leading group is at order[0] and the
+    // remaining pawns, if both sides have pawns, at order[1].
+    bool pp = e.has_pawns && e.pawn_count[1];
+    int next = pp ? 2 : 1;
+    int free_squares = 64 - d->group_len[0] - (pp ? d->group_len[1] : 0);
+    uint64_t idx = 1;
+
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d->group_idx[0] = idx;
+            idx *= e.has_pawns ? lead_pawns_size[d->group_len[0]][file] : e.has_unique_pieces ? 31332 : 462;
+        } else if (k == order[1]) {
+            d->group_idx[1] = idx;
+            idx *= binomial[d->group_len[1]][48 - d->group_len[0]];
+        } else {
+            d->group_idx[next] = idx;
+            idx *= binomial[d->group_len[next]][free_squares];
+            free_squares -= d->group_len[next++];
+        }
+    }
+    d->group_idx[n] = idx;
+}
+
+// parse the table layout; return false if it does not match the table
+bool set(TBTable& e, const uint8_t* data) {
+    enum { SPLIT = 1, HAS_PAWNS = 2 };
+
+    if (e.has_pawns != bool(*data & HAS_PAWNS) ||
+        (e.type == TB_WDL && (e.key != e.key2) != bool(*data & SPLIT))) {
+        return false;
+    }
+    data++;
+
+    const int sides = e.type == TB_WDL && e.key != e.key2 ? 2 : 1;
+    const int max_file = e.has_pawns ? 3 : 0;
+    bool pp = e.has_pawns && e.pawn_count[1];
+
+    for (int f = 0; f <= max_file; f++) {
+        for (int i = 0; i < sides; i++) {
+            *e.get(i, f) = PairsData();
+        }
+
+        int order[2][2] = {{*data & 0xF, pp ? *(data + 1) & 0xF : 0xF},
+                           {*data >> 4, pp ? *(data + 1) >> 4 : 0xF}};
+        data += 1 + pp;
+
+        for (int k = 0; k < e.piece_count; k++, data++) {
+            for (int i = 0; i < sides; i++) {
+                e.get(i, f)->pieces[k] = i ? *data >> 4 : *data & 0xF;
+            }
+        }
+
+        for (int i = 0; i < sides; i++) {
+            set_groups(e, e.get(i, f), order[i], f);
+        }
+    }
+
+    data += (uintptr_t) data & 1;  // word alignment
+
+    for (int f = 0; f <= max_file; f++) {
+        for (int i = 0; i < sides; i++) {
+            data = set_sizes(e.get(i, f), data);
+        }
+    }
+
+    if (e.type == TB_DTZ) {
+        data = set_dtz_map(e, data, max_file);
+    }
+
+    for (int f = 0; f <= max_file; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData* d = e.get(i, f);
+            d->sparse_index = (const SparseEntry*) data;
+            data += d->sparse_index_size * sizeof(SparseEntry);
+        }
+    }
+
+    for (int f = 0; f <= max_file; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData* d = e.get(i, f);
+            d->block_length = data;
+            data += d->block_length_size * sizeof(uint16_t);
+        }
+    }
+
+    for (int f = 0; f <= max_file; f++) {
+        for (int i = 0; i < sides; i++) {
+            data = (const uint8_t*) (((uintptr_t) data + 0x3F) & ~(uintptr_t) 0x3F);  // 64-byte alignment
+            PairsData* d = e.get(i, f);
+            d->data = data;
+            data += (uint64_t) d->num_blocks * d->sizeof_block;
+        }
+    }
+
+    return data <= e.end;
+}
+
+// map the table on first use; return whether it is available
+bool mapped(TBTable& e) {
+    if (e.ready.load(std::memory_order_acquire)) {
+        return e.file.is_open();
+    }
+
+    std::lock_guard<std::mutex> lk(map_mutex);
+    if (e.ready.load(std::memory_order_relaxed)) {
+        return e.file.is_open();
+    }
+
+    const uint8_t* data = map_file(e, e.code + (e.type == TB_WDL ? ".rtbw" : ".rtbz"));
+    if (data && !set(e, data)) {
+        LOG(logERROR) << "Tablebase file '" << e.code << "' does not match its material";
+        e.file.close();
+    }
+    e.ready.store(true, std::memory_order_release);
+    return e.file.is_open();
+}
+
+/* probing */
+
+// decompress the value at index idx
+int decompress_pairs(PairsData* d, uint64_t idx) {
+    if (d->flags & FLAG_SINGLE_VALUE) {
+        return d->min_sym_len;
+    }
+
+    // Block n stores block_length[n] + 1 values. The sparse index gives the block and the offset
+    // of the value at k * span + span / 2; from there, walk the blocks to the one holding idx.
+    uint32_t k = uint32_t(idx / d->span);
+    uint32_t block = read_le32(d->sparse_index[k].block);
+    int offset = read_le16(d->sparse_index[k].offset);
+    offset += int(idx % d->span) - int(d->span / 2);
+
+    while (offset < 0) {
+        offset += read_le16(d->block_length + 2 * --block) + 1;
+    }
+    while (offset > read_le16(d->block_length + 2 * block)) {
+        offset -= read_le16(d->block_length + 2 * block++) + 1;
+    }
+
+    // decode the Huffman symbols of the block until the one covering offset
+    const uint8_t* ptr = d->data + (uint64_t) block * d->sizeof_block;
+    uint64_t buf64 = read_be64(ptr);
+    ptr += 8;
+    int buf64_size = 64;
+    Sym sym;
+
+    while (true) {
+        int len = 0;  // symbol length - min_sym_len
+        while (buf64 < d->base64[len]) {
+            len++;
+        }
+        sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->min_sym_len));
+        sym += read_le16(d->lowest_sym + 2 * len);
+
+        if (offset < d->symlen[sym] + 1) {
+            break;
+        }
+
+        offset -= d->symlen[sym] + 1;
+        len += d->min_sym_len;
+        buf64 <<= len;
+        buf64_size -= len;
+        if (buf64_size <= 32) {
+            buf64_size += 32;
+            buf64 |= (uint64_t) read_be32(ptr) << (64 - buf64_size);
+            ptr += 4;
+        }
+    }
+
+    // expand the symbol down to the value at offset
+    while (d->symlen[sym]) {
+        Sym left = d->btree[sym].left();
+        if (offset < d->symlen[left] + 1) {
+            sym = left;
+        } else {
+            offset -= d->symlen[left] + 1;
+            sym = d->btree[sym].right();
+        }
+    }
+
+    return d->btree[sym].left();
+}
+
+int map_score(TBTable* entry, int file, int value, WDLScore wdl) {
+    if (entry->type == TB_WDL) {
+        return value - 2;
+    }
+
+    constexpr int WDL_MAP[] = {1, 3, 0, 2, 0};
+    PairsData* d = entry->get(0, file);
+    if (d->flags & FLAG_MAPPED) {
+        if (d->flags & FLAG_WIDE) {
+            value = read_le16(entry->map + 2 * (d->map_idx[WDL_MAP[wdl + 2]] + value));
+        } else {
+            value = entry->map[d->map_idx[WDL_MAP[wdl + 2]] + value];
+        }
+    }
+
+    // DTZ is stored in moves or plies; return plies
+    if ((wdl == WDL_WIN && !(d->flags & FLAG_WIN_PLIES)) ||
+        (wdl == WDL_LOSS && !(d->flags & FLAG_LOSS_PLIES)) || wdl == WDL_CURSED_WIN ||
+        wdl == WDL_BLESSED_LOSS) {
+        value *= 2;
+    }
+    return value + 1;
+}
+
+// Compute the index of pos in the table and return its value: a WDLScore for WDL tables, DTZ
+// for DTZ tables
+int probe_table(const Position& pos, TBType type, ProbeState& result, WDLScore wdl = WDL_DRAW) {
+    if (utils::popcount(pos.get_all_bitboard()) == 2) {
+        return WDL_DRAW;  // KvK
+    }
+    if (pos.get_castling_rights()) {
+        result = PROBE_FAIL;
+        return 0;
+    }
+
+    auto it = registry.find(pos.get_material_hash());
+    if (it == registry.end()) {
+        result = PROBE_FAIL;
+        return 0;
+    }
+    TBTable* entry = type == TB_WDL ? it->second.first : it->second.second;
+    if (!mapped(*entry)) {
+        result = PROBE_FAIL;
+        return 0;
+    }
+
+    int squares[TB_PIECES];
+    int pieces[TB_PIECES];
+    uint64_t idx;
+    int next = 0;
+    int size = 0;
+    int lead_pawns_cnt = 0;
+    Bitboard b;
+    Bitboard lead_pawns = 0;
+    int tb_file = 0;
+
+    // Tables store the stronger side as white, and symmetric tables only white to move: flip
+    // colors and squares otherwise.
+    bool symmetric_black_to_move = entry->key == entry->key2 && pos.get_side_to_move() == BLACK;
+    bool black_stronger = pos.get_material_hash() != entry->key;
+    bool flip = symmetric_black_to_move || black_stronger;
+    int flip_color = flip * 8;
+    int flip_squares = flip * 56;
+    int stm = flip ^ (pos.get_side_to_move() == BLACK);
+
+    // With pawns, there is one table per file of the leading pawn, the pawn with the highest
+    // map_pawns value. Pawns of its color come first in the encoding.
+    if (entry->has_pawns) {
+        int pc = entry->get(0, 0)->pieces[0] ^ flip_color;
+        lead_pawns = b = pos.get_bitboard(pc & 8 ? BLACK : WHITE, PAWN);
+        do {
+            squares[size++] = bboard::bitscan_fwd_remove(b) ^ flip_squares;
+        } while (b);
+        lead_pawns_cnt = size;
+
+        std::swap(squares[0], *std::max_element(squares, squares + lead_pawns_cnt, pawns_comp));
+        int file = utils::sq_file(Square(squares[0]));
+        tb_file = std::min(file, 7 - file);
+    }
+
+    // DTZ tables only store one side to move
+    if (type == TB_DTZ) {
+        PairsData* d = entry->get(stm, tb_file);
+        if ((d->flags & FLAG_STM) != stm && !(entry->key == entry->key2 && !entry->has_pawns)) {
+            result = PROBE_CHANGE_STM;
+            return 0;
+        }
+    }
+
+    b = pos.get_all_bitboard() ^ lead_pawns;
+    do {
+        Square sq = bboard::bitscan_fwd_remove(b);
+        SquareInfo sinfo = pos.get_piece(sq);
+        squares[size] = sq ^ flip_squares;
+        pieces[size++] = tb_piece(sinfo.color, sinfo.ptype) ^ flip_color;
+    } while (b);
+
+    PairsData* d = entry->get(stm, tb_file);
+
+    // reorder the pieces as in the table's encoding
+    for (int i = lead_pawns_cnt; i < size - 1; i++) {
+        for (int j = i + 1; j < size; j++) {
+            if (d->pieces[i] == pieces[j]) {
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    // mirror so that the leading piece is on files a-d
+    if (utils::sq_file(Square(squares[0])) > 3) {
+        for (int i = 0; i < size; i++) {
+            squares[i] ^= 7;
+        }
+    }
+
+    if (entry->has_pawns) {
+        idx = lead_pawn_idx[lead_pawns_cnt][squares[0]];
+        std::stable_sort(squares + 1, squares + lead_pawns_cnt, pawns_comp);
+        for (int i = 1; i < lead_pawns_cnt; i++) {
+            idx += binomial[i][map_pawns[squares[i]]];
+        }
+    } else {
+        // without pawns, also mirror so that the leading piece is on ranks 1-4...
+        if (utils::sq_rank(Square(squares[0])) > 3) {
+            for (int i = 0; i < size; i++) {
+                squares[i] ^= 56;
+            }
+        }
+
+        // ...and so that the first piece of the leading group off the a1-h8 diagonal is below it
+        for (int i = 0; i < d->group_len[0]; i++) {
+            if (!off_a1h8(squares[i])) {
+                continue;
+            }
+            if (off_a1h8(squares[i]) > 0) {
+                for (int j = i; j < size; j++) {
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+            }
+            break;
+        }
+
+        if (entry->has_unique_pieces) {
+            // encode the first three pieces together; the later ones skip the earlier squares
+            int adjust1 = (squares[1] > squares[0]) + (squares[2] > squares[0]);
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+            if (off_a1h8(squares[0])) {
+                idx = (map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            } else if (off_a1h8(squares[1])) {
+                idx = (6 * 63 + utils::sq_rank(Square(squares[0])) * 28 + map_b1h1h7[squares[1]]) * 62 +
+                      squares[2] - adjust2;
+            } else if (off_a1h8(squares[2])) {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + utils::sq_rank(Square(squares[0])) * 7 * 28 +
+                      (utils::sq_rank(Square(squares[1])) - adjust1) * 28 + map_b1h1h7[squares[2]];
+            } else {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + utils::sq_rank(Square(squares[0])) * 7 * 6 +
+                      (utils::sq_rank(Square(squares[1])) - adjust1) * 6 +
+                      (utils::sq_rank(Square(squares[2])) - adjust2);
+            }
+        } else {
+            // e.g. KRRvKBB: just the kings
+            idx = map_kk[map_a1d1d4[squares[0]]][squares[1]];
+        }
+    }
+
+    // encode the remaining groups, each in ascending order of squares
+    idx *= d->group_idx[0];
+    int* group_sq = squares + d->group_len[0];
+    bool remaining_pawns = entry->has_pawns && entry->pawn_count[1];
+
+    while (d->group_len[++next]) {
+        std::stable_sort(group_sq, group_sq + d->group_len[next]);
+        uint64_t n = 0;
+        for (int i = 0; i < d->group_len[next]; i++) {
+            // skip the squares taken by the previous groups
+            int adjust = std::count_if(squares, group_sq, [&](int sq) { return group_sq[i] > sq; });
+            n += binomial[i + 1][group_sq[i] - adjust - 8 * remaining_pawns];
+        }
+        remaining_pawns = false;
+        idx += n * d->group_idx[next];
+        group_sq += d->group_len[next];
+    }
+
+    return map_score(entry, tb_file, decompress_pairs(d, idx), wdl);
+}
+
+inline bool is_capture(const Position& pos, Move move) {
+    MoveType type = get_move_type(move);
+    return type == ENPASSANT || (type != CASTLING_MOVE && pos.has_piece(get_move_target(move)));
+}
+
+inline bool is_zeroing(const Position& pos, Move move) {
+    return is_capture(pos, move) ||
+           (get_move_type(move) != CASTLING_MOVE && pos.get_piece(get_move_source(move)).ptype == PAWN);
+}
+
+inline int sign_of(int x) {
+    return (x > 0) - (x < 0);
+}
+
+// DTZ of a position whose best move zeroes the fifty-move counter
+int dtz_before_zeroing(WDLScore wdl) {
+    return wdl == WDL_WIN ? 1 : wdl == WDL_CURSED_WIN ? 101 : wdl == WDL_BLESSED_LOSS ? -101 : wdl == WDL_LOSS ? -1 : 0;
+}
+
+// Tables store "don't care" values for positions where a capture is the best move, and nothing
+// about en-passant, so captures (and with CheckZeroingMoves, pawn moves) are searched first. The
+// best of their results and the stored result is the result of the position. result is set to
+// PROBE_ZEROING_BEST_MOVE if a zeroing move is best, since DTZ is not stored then either.
+template <bool CheckZeroingMoves>
+WDLScore search(Position& pos, ProbeState& result) {
+    WDLScore value;
+    WDLScore best_value = WDL_LOSS;
+    std::vector<Move> moves;
+    gen_legal_moves(pos, moves);
+    size_t move_count = 0;
+
+    for (Move move : moves) {
+        if (!is_capture(pos, move) && (!CheckZeroingMoves || !is_zeroing(pos, move))) {
+            continue;
+        }
+        move_count++;
+
+        pos.make_move(move);
+        value = WDLScore(-search<false>(pos, result));
+        pos.unmake_move(move);
+
+        if (result == PROBE_FAIL) {
+            return WDL_DRAW;
+        }
+        if (value > best_value) {
+            best_value = value;
+            if (value >= WDL_WIN) {
+                result = PROBE_ZEROING_BEST_MOVE;
+                return value;
+            }
+        }
+    }
+
+    // if all legal moves have been searched, the stored value may be wrong, e.g. with en-passant
+    bool no_more_moves = move_count && move_count == moves.size();
+    if (no_more_moves) {
+        value = best_value;
+    } else {
+        value = WDLScore(probe_table(pos, TB_WDL, result));
+        if (result == PROBE_FAIL) {
+            return WDL_DRAW;
+        }
+    }
+
+    if (best_value >= value) {
+        result = best_value > WDL_DRAW || no_more_moves ? PROBE_ZEROING_BEST_MOVE : PROBE_OK;
+        return best_value;
+    }
+    result = PROBE_OK;
+    return value;
+}
+
+// add the table of the given pieces, the first king starting the stronger side, if it exists
+void add_table(const std::vector<PieceType>& pieces) {
+    static const char PIECE_CHARS[] = "PNBRQK";
+    std::string code;
+    for (PieceType pt : pieces) {
+        code += PIECE_CHARS[pt];
+    }
+    code.insert(code.find('K', 1), "v");
+
+    bool found = false;
+    for (const std::string& dir : directories) {
+        if (std::ifstream(dir + "/" + code + ".rtbw").is_open()) {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    int counts[N_COLORS][N_REAL_PIECE_TYPES] = {};
+    Color c = BLACK;
+    for (PieceType pt : pieces) {
+        c = pt == KING ? utils::opposite_color(c) : c;
+        counts[c][pt]++;
+    }
+
+    wdl_tables.emplace_back();
+    TBTable& wdl = wdl_tables.back();
+    wdl.type = TB_WDL;
+    wdl.code = code;
+    wdl.key = 0;
+    wdl.key2 = 0;
+    wdl.has_unique_pieces = false;
+    for (Color side : {WHITE, BLACK}) {
+        for (PieceType pt = PAWN; pt <= KING; pt = (PieceType) (pt + 1)) {
+            for (int n = 0; n < counts[side][pt]; n++) {
+                wdl.key ^= zobrist::get_material_key(side, pt, n);
+                wdl.key2 ^= zobrist::get_material_key(utils::opposite_color(side), pt, n);
+            }
+            if (pt != KING && counts[side][pt] == 1) {
+                wdl.has_unique_pieces = true;
+            }
+        }
+    }
+    wdl.piece_count = (int) pieces.size();
+    wdl.has_pawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+    // the side with fewer pawns leads, since this compresses better
+    bool white_leads = !counts[BLACK][PAWN] || (counts[WHITE][PAWN] && counts[BLACK][PAWN] >= counts[WHITE][PAWN]);
+    wdl.pawn_count[0] = counts[white_leads ? WHITE : BLACK][PAWN];
+    wdl.pawn_count[1] = counts[white_leads ? BLACK : WHITE][PAWN];
+
+    dtz_tables.emplace_back();
+    TBTable& dtz = dtz_tables.back();
+    dtz.type = TB_DTZ;
+    dtz.code = wdl.code;
+    dtz.key = wdl.key;
+    dtz.key2 = wdl.key2;
+    dtz.piece_count = wdl.piece_count;
+    dtz.has_pawns = wdl.has_pawns;
+    dtz.has_unique_pieces = wdl.has_unique_pieces;
+    dtz.pawn_count[0] = wdl.pawn_count[0];
+    dtz.pawn_count[1] = wdl.pawn_count[1];
+
+    registry[wdl.key] = {&wdl, &dtz};
+    registry[wdl.key2] = {&wdl, &dtz};
+    max_cardinality = std::max(max_cardinality, wdl.piece_count);
+}
+}  // namespace
+
+void syzygy::init(const std::string& paths) {
+    init_indices();
+
+    // destroying the tables unmaps their files
+    wdl_tables.clear();
+    dtz_tables.clear();
+    registry.clear();
+    directories.clear();
+    max_cardinality = 0;
+
+    if (paths.empty() || paths == "<empty>") {
+        return;
+    }
+
+    size_t start = 0;
+    while (start <= paths.size()) {
+        size_t end = paths.find(PATH_SEPARATOR, start);
+        end = end == std::string::npos ? paths.size() : end;
+        if (end > start) {
+            directories.push_back(paths.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+
+    // every material configuration of up to 7 pieces, stronger side first
+    for (PieceType p1 = PAWN; p1 < KING; p1 = (PieceType) (p1 + 1)) {
+        add_table({KING, p1, KING});
+        for (PieceType p2 = PAWN; p2 <= p1; p2 = (PieceType) (p2 + 1)) {
+            add_table({KING, p1, p2, KING});
+            add_table({KING, p1, KING, p2});
+            for (PieceType p3 = PAWN; p3 < KING; p3 = (PieceType) (p3 + 1)) {
+                add_table({KING, p1, p2, KING, p3});
+            }
+            for (PieceType p3 = PAWN; p3 <= p2; p3 = (PieceType) (p3 + 1)) {
+                add_table({KING, p1, p2, p3, KING});
+                for (PieceType p4 = PAWN; p4 <= p3; p4 = (PieceType) (p4 + 1)) {
+                    add_table({KING, p1, p2, p3, p4, KING});
+                    for (PieceType p5 = PAWN; p5 <= p4; p5 = (PieceType) (p5 + 1)) {
+                        add_table({KING, p1, p2, p3, p4, p5, KING});
+                    }
+                    for (PieceType p5 = PAWN; p5 < KING; p5 = (PieceType) (p5 + 1)) {
+                        add_table({KING, p1, p2, p3, p4, KING, p5});
+                    }
+                }
+                for (PieceType p4 = PAWN; p4 < KING; p4 = (PieceType) (p4 + 1)) {
+                    add_table({KING, p1, p2, p3, KING, p4});
+                    for (PieceType p5 = PAWN; p5 <= p4; p5 = (PieceType) (p5 + 1)) {
+                        add_table({KING, p1, p2, p3, KING, p4, p5});
+                    }
+                }
+            }
+            for (PieceType p3 = PAWN; p3 <= p1; p3 = (PieceType) (p3 + 1)) {
+                for (PieceType p4 = PAWN; p4 <= (p1 == p3 ? p2 : p3); p4 = (PieceType) (p4 + 1)) {
+                    add_table({KING, p1, p2, KING, p3, p4});
+                }
+            }
+        }
+    }
+
+    std::cout << "info string Found " << wdl_tables.size() << " tablebases" << std::endl;
+}
+
+int syzygy::max_pieces() {
+    return max_cardinality;
+}
+
+WDLScore syzygy::probe_wdl(Position& pos, ProbeState& result) {
+    result = PROBE_OK;
+    return search<false>(pos, result);
+}
+
+int syzygy::probe_dtz(Position& pos, ProbeState& result) {
+    result = PROBE_OK;
+    WDLScore wdl = search<true>(pos, result);
+
+    // DTZ tables do not store draws
+    if (result == PROBE_FAIL || wdl == WDL_DRAW) {
+        return 0;
+    }
+    if (result == PROBE_ZEROING_BEST_MOVE) {
+        return dtz_before_zeroing(wdl);
+    }
+
+    int dtz = probe_table(pos, TB_DTZ, result, wdl);
+    if (result == PROBE_FAIL) {
+        return 0;
+    }
+    if (result != PROBE_CHANGE_STM) {
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) * sign_of(wdl);
+    }
+
+    // the table stores the other side to move: take the best DTZ after one move
+    int min_dtz = 0xFFFF;
+    std::vector<Move> moves;
+    gen_legal_moves(pos, moves);
+    for (Move move : moves) {
+        bool zeroing = is_zeroing(pos, move);
+        pos.make_move(move);
+
+        // for zeroing moves, the DTZ is that of the move itself
+        dtz = zeroing ? -dtz_before_zeroing(search<false>(pos, result)) : -probe_dtz(pos, result);
+
+        // a mating move has DTZ 1
+        if (dtz == 1 && pos.is_checking()) {
+            std::vector<Move> replies;
+            gen_legal_moves(pos, replies);
+            if (replies.empty()) {
+                min_dtz = 1;
+            }
+        }
+
+        if (!zeroing) {
+            dtz += sign_of(dtz);
+        }
+        // skip draws, and only take DTZ of the right sign
+        if (dtz < min_dtz && sign_of(dtz) == sign_of(wdl)) {
+            min_dtz = dtz;
+        }
+
+        pos.unmake_move(move);
+        if (result == PROBE_FAIL) {
+            return 0;
+        }
+    }
+
+    // no legal moves: mated
+    return min_dtz == 0xFFFF ? -1 : min_dtz;
+}
+
+bool syzygy::filter_root_moves(Position& pos, std::vector<Move>& moves) {
+    if (utils::popcount(pos.get_all_bitboard()) > max_cardinality || pos.get_castling_rights() ||
+        moves.empty()) {
+        return false;
+    }
+
+    const int cnt50 = pos.get_halfmove_clock();
+    ProbeState result = PROBE_OK;
+    std::vector<int> ranks;
+
+    // rank by DTZ counted from the root: wins within the fifty-move rule first, fastest first;
+    // losses that the fifty-move rule may save before other losses, slowest first
+    for (Move move : moves) {
+        pos.make_move(move);
+        int dtz;
+        if (pos.get_halfmove_clock() == 0) {
+            dtz = dtz_before_zeroing(WDLScore(-probe_wdl(pos, result)));
+        } else {
+            dtz = -probe_dtz(pos, result);
+            dtz += sign_of(dtz);
+        }
+        if (dtz == 2 && pos.is_checking()) {
+            std::vector<Move> replies;
+            gen_legal_moves(pos, replies);
+            dtz = replies.empty() ? 1 : dtz;
+        }
+        pos.unmake_move(move);
+        if (result == PROBE_FAIL) {
+            break;
+        }
+
+        int rank = dtz > 0 ? (dtz + cnt50 <= 99 ? 20000 : 10000) - dtz
+                 : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -20000 : -10000) - dtz
+                 : 0;
+        ranks.push_back(rank);
+    }
+
+    // fall back to WDL
+    if (result == PROBE_FAIL) {
+        ranks.clear();
+        for (Move move : moves) {
+            pos.make_move(move);
+            WDLScore wdl = WDLScore(-probe_wdl(pos, result));
+            pos.unmake_move(move);
+            if (result == PROBE_FAIL) {
+                return false;
+            }
+            ranks.push_back(wdl);
+        }
+    }
+
+    int best = *std::max_element(ranks.begin(), ranks.end());
+    std::vector<Move> kept;
+    for (size_t i = 0; i < moves.size(); i++) {
+        if (ranks[i] == best) {
+            kept.push_back(moves[i]);
+        }
+    }
+    moves = kept;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+/*
+ * Syzygy endgame tablebase probing, following the probing code of Fathom and Stockfish.
+ *
+ * Tables are found in the directories of the SyzygyPath UCI option (separated by ':', or ';' on
+ * Windows) and memory mapped on first use. A .rtbw file stores the win/draw/loss result of every
+ * position of its material configuration, a .rtbz file stores the distance to the next zeroing
+ * move (DTZ) for one side to move. Positions with castling rights are never probed.
+ *
+ * The search probes WDL at nodes right after a capture or pawn move, and uses DTZ at the root to
+ * keep only the moves that preserve the best result (see filter_root_moves).
+ */
+
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "position.h"
+
+namespace syzygy {
+
+// win/draw/loss from the side to move's point of view. Cursed wins and blessed losses are
+// wins and losses that the fifty-move rule turns into draws.
+enum WDLScore {
+    WDL_LOSS = -2,
+    WDL_BLESSED_LOSS = -1,
+    WDL_DRAW = 0,
+    WDL_CURSED_WIN = 1,
+    WDL_WIN = 2
+};
+
+enum ProbeState {
+    PROBE_FAIL = 0,
+    PROBE_OK = 1,
+    // the DTZ table only stores the other side to move
+    PROBE_CHANGE_STM = -1,
+    // the best move zeroes the fifty-move counter, so DTZ is not stored
+    PROBE_ZEROING_BEST_MOVE = 2
+};
+
+// score of a tablebase win; below mate scores, above any evaluation
+constexpr Score TB_WIN = 30000;
+
+// Unmap any loaded tables and look for tables in paths. An empty path or "<empty>" disables
+// probing. Must not be called during a search.
+void init(const std::string& paths);
+
+// number of pieces of the largest table found, 0 if there are none
+int max_pieces();
+
+// Probe the win/draw/loss of pos. On failure, result is PROBE_FAIL.
+WDLScore probe_wdl(Position& pos, ProbeState& result);
+
+// Probe the number of plies to the next zeroing move of pos, signed by the result: positive if
+// the side to move wins, negative if it loses, 0 for draws. Cursed wins and blessed losses are
+// offset by 100. On failure, result is PROBE_FAIL.
+int probe_dtz(Position& pos, ProbeState& result);
+
+// Keep only the root moves that preserve the best tablebase result, preferring the fastest
+// conversion when winning and the slowest when losing. Uses WDL if DTZ is not available. Return
+// false, leaving moves untouched, if pos could not be probed.
+bool filter_root_moves(Position& pos, std::vector<Move>& moves);
+
+}  // namespace syzygy
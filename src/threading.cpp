@@ -2,6 +2,7 @@
 #include "movegen.h"
 #include "notation.h"
 #include "logger.h"
+#include "syzygy.h"
 
 #include <iostream>
 #include <cassert>
@@ -26,9 +27,7 @@ std::vector<Move> reconstruct_pv(const Position& position, const ht::Table& tabl
         if (entry.bestmove == NULL_MOVE) {
             break;
         }
-        std::vector<Move> legal_moves;
-        gen_legal_moves(pos, legal_moves);
-        if (find(legal_moves.begin(), legal_moves.end(), entry.bestmove) == legal_moves.end()) {
+        if (!move_allowed(pos, entry.bestmove)) {
             break;
         }
         pv.push_back(entry.bestmove);
@@ -90,11 +89,12 @@ void pv() {
     assert(false);
 }
 
-void bestmove(Move move) {
-    std::cout << "bestmove " << notation::dump_uci_move(move) << std::endl;
+void bestmove(Move move, const Position& pos) {
+    std::cout << "bestmove " << notation::dump_uci_move(move, pos) << std::endl;
 }
 
-void info(const thread::SearchState& state, int depth, const utils::Timer& timer) {
+// pos is the root position; the castling squares are the same for every move of the PV
+void info(const thread::SearchState& state, int depth, const utils::Timer& timer, const Position& pos) {
     #if USE_PESTO
     static float multi = 1.f;
     #else
@@ -104,12 +104,15 @@ void info(const thread::SearchState& state, int depth, const utils::Timer& timer
     	<< " depth " << depth \
         << " nodes " << state.nodes \
         << " tt_hits " << state.tt_hits \
-        << " tt_collisions " << state.tt_collisions;
+        << " tt_collisions " << state.tt_collisions
+        << " tbhits " << state.tb_hits
+        << " eval_hits " << ht::eval_cache().hits
+        << " eval_misses " << ht::eval_cache().misses;
 
     if (state.pv.size() != 0){
         std::cout << " pv";
         for (Move mv : state.pv) {
-            std::cout << " " << notation::dump_uci_move(mv);
+            std::cout << " " << notation::dump_uci_move(mv, pos);
         }
 
         std::cout << " time " << timer.elapsed_millis();
@@ -123,7 +126,6 @@ void info(const thread::SearchState& state, int depth, const utils::Timer& timer
 namespace thread {
 
 // global pool variables
-std::atomic<bool> stop_flag(false);
 int MAX_SEARCH_DEPTH = 80;
 std::vector<Thread *> threads;
 
@@ -164,8 +166,6 @@ void start_search(SearchLimit limit) {
         return;
     }
 
-    stop_flag = false;
-
     for (auto pth : threads) {
         pth->reset();
         pth->set_search_limit(limit);
@@ -177,7 +177,27 @@ void start_search(SearchLimit limit) {
 
 void stop_search() {
     main_thread()->diagnostics();
-    stop_flag = true;
+    for (auto pth : threads) {
+        pth->stop();
+    }
+}
+
+bool is_searching() {
+    return main_thread()->is_searching();
+}
+
+void wait_for_search() {
+    main_thread()->wait_for_search();
+}
+
+void set_search_params(const SearchParams& params) {
+    for (auto pth : threads) {
+        pth->set_search_params(params);
+    }
+}
+
+const SearchParams& get_search_params() {
+    return main_thread()->get_search_params();
 }
 
 void cleanup() {
@@ -186,7 +206,23 @@ void cleanup() {
     }
 }
 
-Thread::Thread() : inner_thread(&Thread::thread_func, this), start_flag(false) {
+Thread::Thread()
+    : start_flag(false),
+      quit_flag(false),
+      stop_flag(false),
+      table(&ht::global_table()),
+      silent(false),
+      inner_thread(&Thread::thread_func, this) {
+}
+
+Thread::~Thread() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lk(start_m);
+        quit_flag = true;
+    }
+    start_cv.notify_all();
+    inner_thread.join();
 }
 
 void Thread::set_position(const Position& pos) {
@@ -204,9 +240,10 @@ void Thread::set_search_limit(SearchLimit limit) {
 void Thread::start_search() {
     {
         std::lock_guard<std::mutex> lk(start_m);
+        stop_flag = false;
         start_flag = true;
     }
-    start_cv.notify_one();
+    start_cv.notify_all();
 }
 
 bool Thread::is_searching() {
@@ -214,6 +251,35 @@ bool Thread::is_searching() {
     return start_flag;
 }
 
+void Thread::stop() {
+    stop_flag = true;
+}
+
+void Thread::wait_for_search() {
+    std::unique_lock<std::mutex> lk(start_m);
+    start_cv.wait(lk, [this]{ return !start_flag; });
+}
+
+const SearchState& Thread::get_state() const {
+    return state;
+}
+
+void Thread::set_search_params(const SearchParams& params) {
+    this->params = params;
+}
+
+const SearchParams& Thread::get_search_params() const {
+    return params;
+}
+
+void Thread::set_table(ht::Table* table) {
+    this->table = table;
+}
+
+void Thread::set_silent(bool silent) {
+    this->silent = silent;
+}
+
 bool Thread::am_main() {
     return this == main_thread();
 }
@@ -223,7 +289,10 @@ void Thread::thread_func() {
         {
             // wait for a start signal
             std::unique_lock<std::mutex> lk(start_m);
-            start_cv.wait(lk, [this]{ return start_flag; });
+            start_cv.wait(lk, [this]{ return start_flag || quit_flag; });
+            if (quit_flag) {
+                return;
+            }
         }
 
         // starting search
@@ -234,6 +303,7 @@ void Thread::thread_func() {
             std::lock_guard<std::mutex> lk(start_m);
             start_flag = false;
         }
+        start_cv.notify_all();
     }
 }
 
@@ -257,8 +327,9 @@ inline bool Thread::check_return() {
 inline bool Thread::check_tc_return() {
     // TODO add fixed time control, etc.
     // multiply by 0.5 as a heuristic to estimate how much time the next iteration will take
-    bool stop = time_alloc != 0 && timer.elapsed_millis() > 0.6 * time_alloc;
-    stop |= limit.fixed_time != 0 && timer.elapsed_millis() > 0.6 * limit.fixed_time;
+    const float factor = params.time_factor_pct / 100.f;
+    bool stop = time_alloc != 0 && timer.elapsed_millis() > factor * time_alloc;
+    stop |= limit.fixed_time != 0 && timer.elapsed_millis() > factor * limit.fixed_time;
     if (stop) {
         assert(state.best_move != NULL_MOVE);
         // if (am_main()) {
@@ -282,12 +353,14 @@ void Thread::search() {
         int n_moves = std::min(position.get_fullmove_number(), 10);  // tune this number
         float factor = 2 - n_moves / 10.f;
 
-        int moves_left = std::max(45 - n_moves, 5);
+        int moves_left = std::max(params.moves_horizon - n_moves, 5);
         float target = time_left / moves_left;
         time_alloc = target * factor;
     }
 
     timer.zero();
+    // the eval cache belongs to this thread, so its stats can only be reset from here
+    ht::eval_cache().reset_stats();
 
     state.best_eval = 0;
     state.best_move = NULL_MOVE;
@@ -296,15 +369,21 @@ void Thread::search() {
     std::vector<Move> moves;
     gen_legal_moves(position, moves);
 
+    // keep only the moves that preserve the tablebase result
+    if (syzygy::filter_root_moves(position, moves)) {
+        state.tb_hits++;
+    }
+
     // initialize state to garbage values, in case we don't get to search at all.
 
-    // set to 4 if there is no depth limit; otherwise set to min(4, target_depth) to avoid having
-    // a loop like (4..3), e.g. if target depth is 3
-    int start_depth = limit.depth == 0 ? 4 : std::min(4, limit.depth);
+    // set to start_depth if there is no depth limit; otherwise set to min(start_depth, target_depth)
+    // to avoid having a loop like (4..3), e.g. if target depth is 3
+    int start_depth = limit.depth == 0 ? params.start_depth : std::min(params.start_depth, limit.depth);
     for (int depth = start_depth; ; depth++) {
         if (limit.depth != 0 && depth > limit.depth) {
             break;
         }
+        state.root_depth = depth;
 
         // need to reorder scores since best_move might have changed
         std::vector<int> move_scores = score_moves(position, moves, state.best_move);
@@ -320,6 +399,9 @@ void Thread::search() {
                 break;
             }
 
+            #if USE_COPY_MAKE
+            PositionSnapshot saved = position.snapshot();
+            #endif
             position.make_move(move);
             state.nodes++;
             state.cur_depth = 0;
@@ -327,9 +409,9 @@ void Thread::search() {
             state.cur_depth++;
             state.max_depth_searched = std::max(state.cur_depth, state.max_depth_searched);
 
-            if (ht::global_table().contains(position.get_hash())) {
+            if (table->contains(position.get_hash())) {
                 // state.tt_hits++;
-            } else if (ht::global_table().has_collision(position.get_hash())) {
+            } else if (table->has_collision(position.get_hash())) {
                 state.tt_collisions++;
             }
 
@@ -337,7 +419,11 @@ void Thread::search() {
             // LOG(logERROR) << "finished depth search";
 
             state.cur_depth--;
+            #if USE_COPY_MAKE
+            position.restore(saved);
+            #else
             position.unmake_move(move);
+            #endif
 
             if (stop_flag) {
                 // early stop; can't use the value for this move
@@ -357,7 +443,7 @@ void Thread::search() {
             state.best_move = moves[0];
         }
 
-        ht::global_table().put(ht::Entry{
+        table->put(ht::Entry{
             position.get_hash(),  // key
             (unsigned) depth,  // depth
             alpha,  // score
@@ -365,16 +451,20 @@ void Thread::search() {
             1,  // node type
         });
 
-        auto pv = reconstruct_pv(position, ht::global_table());
+        auto pv = reconstruct_pv(position, *table);
         state.pv = pv;
-        uci::info(state, depth, timer);
+        if (!silent) {
+            uci::info(state, depth, timer, position);
+        }
 
 		if (stop_flag) break;
         if (check_tc_return()) break;
     }
     // reconstruct PV
     // uci::info(state);
-    uci::bestmove(state.best_move);
+    if (!silent) {
+        uci::bestmove(state.best_move, position);
+    }
     // std::cout << notation::to_aligned_fen(position) << std::endl;
         // // reinsert best move as the first move in the vector, so that it is explored first in the
         // // next iteration
@@ -383,9 +473,9 @@ void Thread::search() {
         // depth++;
 }
 
-bool Thread::probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Move>& moves, Move& pv_move, Score& out_eval) {
+bool Thread::probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Move>& moves, Bitboard pinned, Move& pv_move, Score& out_eval) {
     ZobristKey hash_key = position.get_hash();
-    ht::Entry entry = ht::global_table().get(hash_key);
+    ht::Entry entry = table->get(hash_key);
     if (entry.key == hash_key) {
         // HACK the second condition tests if entry.depth == 0 && depth == 1000, since depth is
         // either << 1000 or == 1000, as in the case of qsearch. If entry and the caller of probe_tt
@@ -397,6 +487,9 @@ bool Thread::probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Mo
             if (entry.node_type == 1) {
                 if (entry.score < 0) {
                     for (Move move : moves) {
+                        if (!is_legal(position, move, pinned)) {
+                            continue;
+                        }
                         position.make_move(move);
                         if (position.is_drawn_by_threefold()) {
                             position.unmake_move(move);
@@ -427,7 +520,7 @@ bool Thread::probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Mo
         if (entry.bestmove != NULL_MOVE) {
             pv_move = entry.bestmove;
         }
-    } else if (ht::global_table().has_collision(position.get_hash())) {
+    } else if (table->has_collision(position.get_hash())) {
         state.tt_collisions++;
     }
 
@@ -435,15 +528,17 @@ bool Thread::probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Mo
 }
 
 Score Thread::depth_search(Score alpha, Score beta, int depth) {
-    if (state.nodes % 2048 == 2047) {
+    if (state.nodes % params.node_check_interval == (unsigned long) params.node_check_interval - 1) {
         if (check_return()) {
             stop_flag = true;
             return alpha;
         }
     }
 
+    // moves are pseudo-legal and checked with is_legal() only when tried
     std::vector<Move> moves;
-    bool checking = gen_legal_moves(position, moves);
+    Bitboard pinned;
+    bool checking = gen_pseudo_legal_moves(position, moves, pinned);
 
     if (position.is_drawn_by_50()) {
         return SCORE_DRAW;
@@ -458,13 +553,13 @@ Score Thread::depth_search(Score alpha, Score beta, int depth) {
     #if USE_TT
     Score tt_eval;
     // probe_tt tells us whether tt_eval is populated and we should return now
-    if (probe_tt(alpha, beta, depth, moves, pv_move, tt_eval)) {
+    if (probe_tt(alpha, beta, depth, moves, pinned, pv_move, tt_eval)) {
         return tt_eval;
     }
     #endif
 
     short node_type = 3;
-    if (moves.size() == 0) {
+    if (!has_legal_move(position, moves, pinned)) {
         if (checking) {
             // I lose
             return SCORE_NEG_INFTY + position.get_halfmove_clock();
@@ -472,6 +567,29 @@ Score Thread::depth_search(Score alpha, Score beta, int depth) {
             return SCORE_DRAW;
         }
     }
+
+    // probe the tablebases right after captures and pawn moves, when the result is exact
+    if (position.get_halfmove_clock() == 0 &&
+        utils::popcount(position.get_all_bitboard()) <= syzygy::max_pieces()) {
+        syzygy::ProbeState result;
+        syzygy::WDLScore wdl = syzygy::probe_wdl(position, result);
+        if (result != syzygy::PROBE_FAIL) {
+            state.tb_hits++;
+            // prefer the shortest path to a won tablebase position
+            Score score = wdl == syzygy::WDL_WIN ? syzygy::TB_WIN - state.cur_depth
+                        : wdl == syzygy::WDL_LOSS ? -syzygy::TB_WIN + state.cur_depth
+                        : SCORE_DRAW;
+            table->put(ht::Entry{
+                position.get_hash(),  // key
+                (unsigned int) (depth - state.cur_depth),  // depth
+                score,  // score
+                NULL_MOVE,  // best_move
+                1,  // node type
+            });
+            return score;
+        }
+    }
+
     // this would never be true if depth == 0, i.e. never initialized
     if (state.cur_depth == depth) {
         #if USE_QSEARCH
@@ -487,15 +605,32 @@ Score Thread::depth_search(Score alpha, Score beta, int depth) {
     for (size_t i = 0; i < moves.size(); i++) {
 
         Move move = pick_move(moves, move_scores, i);
+        if (!is_legal(position, move, pinned)) {
+            continue;
+        }
+
+        int child_depth = depth;
+        #if USE_CHECK_EXTENSIONS
+        if (depth - state.root_depth < params.max_check_extensions && position.gives_check(move)) {
+            child_depth++;
+        }
+        #endif
 
+        #if USE_COPY_MAKE
+        PositionSnapshot saved = position.snapshot();
+        #endif
         position.make_move(move);
         assert(position.position_good());
         state.nodes++;
         state.cur_depth++;
         state.max_depth_searched = std::max(state.cur_depth, state.max_depth_searched);
-        Score s = -depth_search(-beta, -alpha, depth);
+        Score s = -depth_search(-beta, -alpha, child_depth);
         state.cur_depth--;
+        #if USE_COPY_MAKE
+        position.restore(saved);
+        #else
         position.unmake_move(move);
+        #endif
         if (stop_flag) {
             return alpha;  // TODO break?
         }
@@ -515,7 +650,7 @@ Score Thread::depth_search(Score alpha, Score beta, int depth) {
         }
     }
 
-    ht::global_table().put(ht::Entry{
+    table->put(ht::Entry{
         position.get_hash(),  // key
         (unsigned int) (depth - state.cur_depth),  // depth
         alpha,  // score
@@ -527,7 +662,7 @@ Score Thread::depth_search(Score alpha, Score beta, int depth) {
 }
 
 Score Thread::qsearch(Score alpha, Score beta) {
-    if (state.nodes % 2048 == 2047) {
+    if (state.nodes % params.node_check_interval == (unsigned long) params.node_check_interval - 1) {
         if (check_return()) {
             stop_flag = true;
             return alpha;
@@ -578,7 +713,8 @@ Score Thread::qsearch(Score alpha, Score beta) {
     Score tt_eval;
     // probe_tt tells us whether tt_eval is populated and we should return now
     // give a large value for depth so that we don't return early (see probe_tt for the condition check)
-    if (probe_tt(alpha, beta, 1000, capture_moves, pv_move, tt_eval)) {
+    // the moves are legal, so no pinned pieces need to be passed
+    if (probe_tt(alpha, beta, 1000, capture_moves, 0ULL, pv_move, tt_eval)) {
         return tt_eval;
     }
     #endif
@@ -590,6 +726,9 @@ Score Thread::qsearch(Score alpha, Score beta) {
 
         Move move = pick_move(capture_moves, move_scores, i);
 
+        #if USE_COPY_MAKE
+        PositionSnapshot saved = position.snapshot();
+        #endif
         position.make_move(move);
         assert(position.position_good());
         state.nodes++;
@@ -597,7 +736,11 @@ Score Thread::qsearch(Score alpha, Score beta) {
         state.max_depth_searched = std::max(state.cur_depth, state.max_depth_searched);
         Score s = -qsearch(-beta, -alpha);
         state.cur_depth--;
+        #if USE_COPY_MAKE
+        position.restore(saved);
+        #else
         position.unmake_move(move);
+        #endif
 
         if (stop_flag) {
             return alpha;
@@ -616,7 +759,7 @@ Score Thread::qsearch(Score alpha, Score beta) {
         }
     }
 
-    ht::global_table().put(ht::Entry{
+    table->put(ht::Entry{
         position.get_hash(),  // key
         (unsigned int) 0,  // special depth for qsearch
         alpha,  // score
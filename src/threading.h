@@ -23,16 +23,19 @@ struct SearchState {
    Score best_eval;
    std::vector<Move> pv;
    int cur_depth;
+   int root_depth;  // depth of the current iteration, before extensions
    int max_depth_searched;
    int tt_hits;  // transposition table hits
    int tt_collisions;
+   int tb_hits;  // tablebase probes
 };
 
 // One thread represents one search task with one root node.
 class Thread {
    public:
     Thread();
-    virtual ~Thread() {}
+    // stops any running search and joins the inner thread
+    virtual ~Thread();
 
     // set the root position
     void set_position(const Position& pos);
@@ -46,6 +49,19 @@ class Thread {
     virtual void start_search();
     // whether a search is already in place
     bool is_searching();
+    // ask a running search to stop
+    void stop();
+    // block until the current search, if any, has finished
+    void wait_for_search();
+    // state of the last search, e.g. its best move; only valid when not searching
+    const SearchState& get_state() const;
+    // set the tunable search constants
+    void set_search_params(const SearchParams& params);
+    const SearchParams& get_search_params() const;
+    // use table instead of the global transposition table
+    void set_table(ht::Table* table);
+    // suppress UCI output, e.g. for self-play
+    void set_silent(bool silent);
     void diagnostics() {
       //  std::cout << "Printing Diagnostics" << std::endl;
       //  std::cout << state.cur_depth << std::endl;
@@ -61,7 +77,7 @@ class Thread {
     // helper search function using members such as SearchLimit.
     void search();
 
-    bool probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Move>& moves, Move& pv_move, Score &out_eval);
+    bool probe_tt(Score& alpha, Score& beta, int depth, const std::vector<Move>& moves, Bitboard pinned, Move& pv_move, Score &out_eval);
 
     // search for a fixed number of plies from position, based on cur_depth and 
     Score depth_search(Score alpha, Score beta, int depth);
@@ -74,10 +90,15 @@ class Thread {
     bool check_tc_return();
 
 
-    std::thread inner_thread;
     std::condition_variable start_cv;
     std::mutex start_m;
     bool start_flag;
+    bool quit_flag;
+    std::atomic<bool> stop_flag;
+
+    SearchParams params;
+    ht::Table* table;
+    bool silent;
 
     Position position;
     SearchLimit limit;
@@ -86,6 +107,9 @@ class Thread {
     utils::Timer timer;
 
     float time_alloc;
+
+    // declared last so that the members above are initialized before thread_func runs
+    std::thread inner_thread;
 };  // class Thread
 
 // A single master thread is launched for each program. Normally it does
@@ -102,6 +126,12 @@ class MainThread : public Thread {
 void set_num_threads(int n_threads);
 void start_search(SearchLimit limit);
 void stop_search();
+// whether the main thread is searching
+bool is_searching();
+// block until the main thread's search, if any, has finished
+void wait_for_search();
+void set_search_params(const SearchParams& params);
+const SearchParams& get_search_params();
 void set_position(const Position& pos);
 const Position& get_position();
 void cleanup();
@@ -9,6 +9,10 @@
 #define USE_TT 1
 #define USE_MOVE_ORDERING 1
 #define USE_QSEARCH 0
+// search checking moves one ply deeper
+#define USE_CHECK_EXTENSIONS 1
+// undo moves in search by restoring a PositionSnapshot instead of unmake_move
+#define USE_COPY_MAKE 0
 
 using Bitboard = uint64_t;
 using ZobristKey = uint64_t;
@@ -36,6 +40,7 @@ constexpr Bitboard WHITE_HALF = RANK_A | RANK_B | RANK_C | RANK_D;
 constexpr Bitboard BLACK_HALF = ~WHITE_HALF;
 
 constexpr Bitboard ROOK_FILES = 0x8181818181818181;
+constexpr Bitboard DARK_SQUARES = 0xAA55AA55AA55AA55;
 
 struct Direction {
     I8 d_rank;
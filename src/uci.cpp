@@ -6,12 +6,20 @@
 #include "logger.h"
 #include "notation.h"
 #include "hash.h"
+#include "book.h"
+#include "bench.h"
+#include "endgame.h"
 #include "evaluate.h"
+#include "nnue.h"
+#include "spsa.h"
+#include "syzygy.h"
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <atomic>
 
@@ -22,11 +30,15 @@ using std::endl;
 using std::istringstream;
 using std::string;
 
+// the UCI_Chess960 option: castling moves are the king capturing its own rook
+static bool chess960 = false;
+
 void run_position(istringstream &iss)
 {
     string fen;
     iss >> fen;
     Position pos;
+    pos.set_chess960(chess960);
     if (fen == "startpos")
     {
         // already default FEN
@@ -57,9 +69,16 @@ void run_position(istringstream &iss)
     thread::set_position(pos);
 }
 
-void run_go_perft(int depth)
+// number of perft workers; all cores unless given
+int perft_threads(std::unordered_map<string, string> &args)
+{
+    int n_threads = std::stoi(utils::get_or_default(args, string("threads"), string("0")));
+    return n_threads > 0 ? n_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+void run_go_perft(int depth, int n_threads)
 {
-    int result = perft(thread::get_position(), depth);
+    U64 result = perft(thread::get_position(), depth, n_threads, ht::PERFT_TABLE_SZ);
     cout << result << endl;
 }
 
@@ -81,10 +100,127 @@ void delegate_command(const string &command, istringstream &liness)
 {
 }
 
+void print_options()
+{
+    cout << "option name EvalFile type string default <empty>" << endl;
+    cout << "option name SyzygyPath type string default <empty>" << endl;
+    cout << "option name BookFile type string default <empty>" << endl;
+    cout << "option name UCI_Chess960 type check default false" << endl;
+    const SearchParams defaults;
+    for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+        const SearchParamSpec &spec = SEARCH_PARAM_SPECS[i];
+        cout << "option name " << spec.name << " type spin default " << defaults.*spec.field
+             << " min " << spec.min << " max " << spec.max << endl;
+    }
+}
+
+// set a SearchParams field from its UCI option; return false if name is not a search parameter
+bool set_search_param(const string &name, const string &value)
+{
+    for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+        const SearchParamSpec &spec = SEARCH_PARAM_SPECS[i];
+        if (name != spec.name) {
+            continue;
+        }
+        SearchParams params = thread::get_search_params();
+        try {
+            params.*spec.field = std::clamp(std::stoi(value), spec.min, spec.max);
+        } catch (const std::exception &) {
+            cerr << "Invalid value '" << value << "' for option '" << name << "'" << endl;
+            return true;
+        }
+        thread::set_search_params(params);
+        return true;
+    }
+    return false;
+}
+
+void set_eval_file(const string &path)
+{
+    if (path.empty() || path == "<empty>") {
+        nnue::unload();
+        return;
+    }
+    if (!nnue::load(path)) {
+        return;
+    }
+    // positions set before the network was loaded have no accumulator yet
+    Position pos = thread::get_position();
+    pos.refresh_accumulator();
+    thread::set_position(pos);
+}
+
+// setoption name <id> [value <x>]
+void run_setoption(istringstream &iss)
+{
+    string token;
+    string name;
+    string value;
+    iss >> token;
+    if (token != "name") {
+        cerr << "malformed command" << endl;
+        return;
+    }
+    // names and values may contain spaces
+    while (iss >> token && token != "value") {
+        name += (name.empty() ? "" : " ") + token;
+    }
+    while (iss >> token) {
+        value += (value.empty() ? "" : " ") + token;
+    }
+
+    if ((name == "EvalFile" || name == "SyzygyPath" || name == "BookFile") && thread::is_searching()) {
+        // the search threads read the network and the tablebases without locking; the book is
+        // treated the same so that these files only change between searches
+        std::cerr << "Cannot change " << name << " while searching, so this command is ignored." << std::endl;
+        return;
+    }
+
+    if (name == "EvalFile") {
+        set_eval_file(value);
+    } else if (name == "SyzygyPath") {
+        syzygy::init(value);
+    } else if (name == "BookFile") {
+        book::open(value);
+    } else if (name == "UCI_Chess960") {
+        chess960 = value == "true";
+    } else if (set_search_param(name, value)) {
+        // done
+    } else {
+        cerr << "Unknown option '" << name << "'" << endl;
+    }
+}
+
+// spsa [iterations <n>] [pairs <n>] [time <ms>] [inc <ms>] [threads <n>] [lr <r>]
+// tune the search parameters by self-play, starting from the current values
+void run_spsa(istringstream &iss)
+{
+    std::unordered_map<string, string> args = parse_keyvalue(iss);
+    spsa::Config config;
+    config.iterations = std::stoi(utils::get_or_default(args, string("iterations"), std::to_string(config.iterations)));
+    config.game_pairs = std::stoi(utils::get_or_default(args, string("pairs"), std::to_string(config.game_pairs)));
+    config.base_time = std::stoi(utils::get_or_default(args, string("time"), std::to_string(config.base_time)));
+    config.increment = std::stoi(utils::get_or_default(args, string("inc"), std::to_string(config.increment)));
+    config.threads = std::stoi(utils::get_or_default(args, string("threads"), std::to_string(config.threads)));
+    config.learning_rate = std::stod(utils::get_or_default(args, string("lr"), std::to_string(config.learning_rate)));
+    spsa::tune(thread::get_search_params(), config);
+}
+
+// bench [depth] [threads] [hash]
+void run_bench(istringstream &iss)
+{
+    int depth = bench::DEFAULT_DEPTH;
+    int threads = bench::DEFAULT_THREADS;
+    int hash_mb = bench::DEFAULT_HASH_MB;
+    iss >> depth >> threads >> hash_mb;
+    bench::run(depth, threads, hash_mb);
+}
+
 void uci::initialize(int argc, char *argv[])
 {
     bboard::initialize();
     zobrist::initialize();
+    endgame::initialize();
     init_eval_tables();
     thread::set_num_threads(1);
 }
@@ -126,6 +262,7 @@ void uci::loop()
             {
                 cout << "id name " << ENGINE_NAME << endl;
                 cout << "id author Gary Geng" << endl;
+                print_options();
                 cout << "uciok" << endl;
             }
             else if (command == "debug")
@@ -138,7 +275,19 @@ void uci::loop()
             }
             else if (command == "setoption")
             {
-                cerr << "setoption not implemented" << endl;
+                run_setoption(liness);
+            }
+            else if (command == "eval")
+            {
+                print_eval_trace(thread::get_position(), cout);
+            }
+            else if (command == "spsa")
+            {
+                run_spsa(liness);
+            }
+            else if (command == "bench")
+            {
+                run_bench(liness);
             }
             else if (command == "ucinewgame")
             {
@@ -152,7 +301,7 @@ void uci::loop()
             {
                 std::unordered_map<string, string> args = parse_keyvalue(liness);
 
-                std::vector<string> constraints{"wtime", "depth", "nodes", "mate", "movetime", "infinite", "perft"};
+                std::vector<string> constraints{"wtime", "depth", "nodes", "mate", "movetime", "infinite", "perft", "divide"};
                 bool constraint_found = false;
                 std::string constraint;
                 std::string value;
@@ -189,25 +338,41 @@ void uci::loop()
                     // Don't set any constraints
                     // LOG(logWARNING) << "infinite constraint not actually implemented.";
                 } else if (constraint == "perft") {
-                    run_go_perft(std::stoi(value));
+                    run_go_perft(std::stoi(value), perft_threads(args));
+                    continue;
+                } else if (constraint == "divide") {
+                    divide(thread::get_position(), std::stoi(value), perft_threads(args), ht::PERFT_TABLE_SZ);
                     continue;
                 } else {
                     LOG(logERROR) << "Constraint not implemented: " << constraint;
                     return;
                 }
 
+                // answer instantly from the opening book, but only in games on the clock: depth,
+                // movetime and infinite searches are analysis and should search the position
+                if (constraint == "wtime") {
+                    Move book_move = book::probe(thread::get_position());
+                    if (book_move != NULL_MOVE) {
+                        cout << "bestmove " << notation::dump_uci_move(book_move, thread::get_position()) << endl;
+                        continue;
+                    }
+                }
+
                 thread::start_search(slimit);
 
             } else if (command == "stop") {
                 thread::stop_search();
             } else if (command == "quit") {
-                thread::stop_search();
-                exit(0);
+                break;
             } else {
                 LOG(logERROR) << "Unknown command: '" << command << "'";
             }
         }
     }
+
+    // quit, or the end of input
+    thread::stop_search();
+    thread::wait_for_search();
 }
 
 void uci::cleanup() {
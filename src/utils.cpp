@@ -4,6 +4,18 @@
 
 #include <fstream>
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 using std::string;
 
 Square utils::KING_INIT_SQUARES[2]{ SQ_E1, SQ_E8 }; 
@@ -49,3 +61,59 @@ string utils::repr(Bitboard bitboard) {
     ret[72] = '\0';
     return string(ret);
 }
+
+bool utils::MappedFile::open(const string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE fd = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (fd == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    DWORD size_high;
+    DWORD size_low = GetFileSize(fd, &size_high);
+    uint64_t size = ((uint64_t) size_high << 32) | size_low;
+    HANDLE mapping = size ? CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr) : nullptr;
+    CloseHandle(fd);
+    if (!mapping) {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return false;
+    }
+    handle = mapping;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat statbuf;
+    uint64_t size = fstat(fd, &statbuf) == 0 ? statbuf.st_size : 0;
+    void* view = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    madvise(view, size, MADV_RANDOM);
+#endif
+    base = (const uint8_t*) view;
+    length = size;
+    return true;
+}
+
+void utils::MappedFile::close() {
+    if (!base) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile((void*) base);
+    CloseHandle((HANDLE) handle);
+    handle = nullptr;
+#else
+    munmap((void*) base, length);
+#endif
+    base = nullptr;
+    length = 0;
+}
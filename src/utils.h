@@ -25,6 +25,17 @@ inline Square make_square(int rank, int file) {
 
 inline Square to_square(uint8_t val) { return static_cast<Square>(val); }
 
+// whether the three squares are collinear
+inline bool aligned(Square sq1, Square sq2, Square sq3) {
+    return (sq_rank(sq2) - sq_rank(sq1)) * (sq_file(sq3) - sq_file(sq1)) ==
+           (sq_rank(sq3) - sq_rank(sq1)) * (sq_file(sq2) - sq_file(sq1));
+}
+
+// rank of sq as seen from c's side of the board, i.e. 0 is c's back rank
+inline int relative_rank(Square sq, Color c) {
+    return c == WHITE ? sq_rank(sq) : 7 - sq_rank(sq);
+}
+
 bool move_square(Square& sq, int d_rank, int d_file);
 
 inline bool move_square(Square& sq, const Direction& dir) {
@@ -36,8 +47,13 @@ inline Square flip(Square sq) {
 }
 
 inline int popcount(unsigned long long n) {
+#if defined(__POPCNT__)
+    // a single POPCNT instruction
+    return __builtin_popcountll(n);
+#else
     return __builtin_popcount((unsigned int)(n)) +
            __builtin_popcount((unsigned int)(n >> 32));
+#endif
 }
 
 inline bool is_slider(PieceType pt) {
@@ -152,6 +168,29 @@ inline V get_or_default(const C<K, V, Args...>& m, K const& key,
     return it->second;
 }
 
+// Read-only memory mapping of a whole file, advised for random access
+class MappedFile {
+   public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // map path, unmapping any previously mapped file; return whether successful
+    bool open(const std::string& path);
+    void close();
+
+    inline bool is_open() const { return base != nullptr; }
+    inline const uint8_t* data() const { return base; }
+    inline uint64_t size() const { return length; }
+
+   private:
+    const uint8_t* base = nullptr;
+    uint64_t length = 0;
+    // mapping handle on Windows
+    void* handle = nullptr;
+};
+
 class Timer {
    public:
     Timer() { zero(); }
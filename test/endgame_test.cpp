@@ -0,0 +1,93 @@
+#include "catch2.hpp"
+
+#include <string>
+
+#include "endgame.h"
+#include "position.h"
+#include "test_utils.h"
+
+namespace {
+
+// score of the registered evaluator of fen, from the strong side's point of view
+Score endgame_eval(const std::string& fen, Color expected_strong) {
+	Position pos = fen_position(fen);
+	Color strong;
+	const endgame::Evaluator* evaluator = endgame::find_evaluator(pos.get_material_hash(), strong);
+	INFO(fen);
+	REQUIRE( evaluator != nullptr );
+	REQUIRE( strong == expected_strong );
+	return evaluator->fn(pos, strong);
+}
+}  // namespace
+
+TEST_CASE("KPK bitbase", "[endgame]") {
+	endgame::initialize();
+
+	SECTION( "king on the sixth rank in front of its pawn wins" ) {
+		REQUIRE( endgame::probe_kpk(SQ_E6, SQ_E5, SQ_E8, true) );
+		REQUIRE( endgame::probe_kpk(SQ_E6, SQ_E5, SQ_E8, false) );
+		REQUIRE( endgame::probe_kpk(SQ_D6, SQ_D5, SQ_D8, false) );
+	}
+
+	SECTION( "opposition decides with the king behind on the fifth rank" ) {
+		// the weak king has the opposition if it is the strong side to move
+		REQUIRE_FALSE( endgame::probe_kpk(SQ_E5, SQ_E4, SQ_E7, true) );
+		REQUIRE( endgame::probe_kpk(SQ_E5, SQ_E4, SQ_E7, false) );
+	}
+
+	SECTION( "rook pawn with the weak king in the corner is a draw" ) {
+		REQUIRE_FALSE( endgame::probe_kpk(SQ_C6, SQ_A5, SQ_A8, true) );
+		REQUIRE_FALSE( endgame::probe_kpk(SQ_C6, SQ_A5, SQ_A8, false) );
+		REQUIRE_FALSE( endgame::probe_kpk(SQ_F6, SQ_H5, SQ_H8, true) );
+	}
+
+	SECTION( "pawn that outruns the weak king" ) {
+		REQUIRE( endgame::probe_kpk(SQ_A1, SQ_B6, SQ_H8, true) );
+		REQUIRE_FALSE( endgame::probe_kpk(SQ_A1, SQ_B6, SQ_C7, false) );
+	}
+
+	SECTION( "evaluator, for either color" ) {
+		REQUIRE( endgame_eval("4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", WHITE) > endgame::KNOWN_WIN );
+		REQUIRE( endgame_eval("8/8/8/8/4p3/4k3/8/4K3 b - - 0 1", BLACK) > endgame::KNOWN_WIN );
+		REQUIRE( endgame_eval("k7/8/2K5/P7/8/8/8/8 w - - 0 1", WHITE) == SCORE_DRAW );
+		REQUIRE( endgame_eval("8/8/8/8/p7/2k5/8/K7 b - - 0 1", BLACK) == SCORE_DRAW );
+	}
+}
+
+TEST_CASE("KBNK drives the king to a corner of the bishop's color", "[endgame]") {
+	endgame::initialize();
+
+	// the same pieces with the weak king in a1 or h1; a1 is dark, h1 light
+	SECTION( "dark-squared bishop" ) {
+		Score dark_corner = endgame_eval("8/8/8/4B3/4N3/2K5/8/k7 b - - 0 1", WHITE);
+		Score light_corner = endgame_eval("8/8/8/4B3/4N3/5K2/8/7k b - - 0 1", WHITE);
+		REQUIRE( dark_corner > endgame::KNOWN_WIN );
+		REQUIRE( dark_corner > light_corner );
+	}
+
+	SECTION( "light-squared bishop" ) {
+		Score dark_corner = endgame_eval("8/8/8/3B4/4N3/2K5/8/k7 b - - 0 1", WHITE);
+		Score light_corner = endgame_eval("8/8/8/3B4/4N3/5K2/8/7k b - - 0 1", WHITE);
+		REQUIRE( light_corner > endgame::KNOWN_WIN );
+		REQUIRE( light_corner > dark_corner );
+	}
+}
+
+TEST_CASE("KRK, KQK and KNNK", "[endgame]") {
+	endgame::initialize();
+
+	SECTION( "KRK and KQK are won and prefer the weak king on the edge" ) {
+		// the kings are two squares apart in both
+		Score edge = endgame_eval("8/8/8/8/8/7R/2K5/k7 w - - 0 1", WHITE);
+		Score center = endgame_eval("8/8/8/3k4/8/2K5/8/7R w - - 0 1", WHITE);
+		REQUIRE( center > endgame::KNOWN_WIN );
+		REQUIRE( edge > center );
+		REQUIRE( endgame_eval("8/8/8/3k4/8/2K5/7Q/8 w - - 0 1", WHITE) > center );
+		REQUIRE( endgame_eval("7q/8/3K4/8/8/2k5/8/8 b - - 0 1", BLACK) > endgame::KNOWN_WIN );
+	}
+
+	SECTION( "KNNK is a draw" ) {
+		REQUIRE( endgame_eval("8/8/3k4/8/8/2K5/8/5NN1 w - - 0 1", WHITE) == SCORE_DRAW );
+		REQUIRE( endgame_eval("5nn1/8/3k4/8/8/2K5/8/8 w - - 0 1", BLACK) == SCORE_DRAW );
+	}
+}
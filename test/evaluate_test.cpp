@@ -0,0 +1,83 @@
+#include "catch2.hpp"
+
+#include <string>
+#include <vector>
+
+#include "endgame.h"
+#include "evaluate.h"
+#include "hash.h"
+#include "notation.h"
+#include "position.h"
+#include "test_utils.h"
+
+namespace {
+
+// the perft positions and their children, repeated up to at least n positions
+std::vector<Position> perft_positions(size_t n) {
+	std::vector<Position> positions;
+	while (positions.size() < n) {
+		for (const std::string& fen : PERFT_FENS) {
+			Position pos = fen_position(fen);
+			walk(pos, 1, [&positions](const Position& p) {
+				positions.push_back(p);
+			});
+		}
+	}
+	positions.resize(n);
+	return positions;
+}
+
+void check_batch(const std::vector<Position>& positions) {
+	std::vector<Score> batch(positions.size());
+	evaluate_batch(positions.data(), batch.data(), positions.size());
+	int mismatches = 0;
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (batch[i] != compute_eval(positions[i]) && mismatches++ == 0) {
+			UNSCOPED_INFO("first mismatch: " << notation::to_aligned_fen(positions[i]));
+		}
+	}
+	INFO("n = " << positions.size());
+	CHECK(mismatches == 0);
+}
+}  // namespace
+
+TEST_CASE("evaluate_batch matches compute_eval", "[evaluate]") {
+	endgame::initialize();
+	init_eval_tables();
+
+	SECTION( "partial lanes" ) {
+		for (size_t n = 1; n <= 17; n++) {
+			check_batch(perft_positions(n));
+		}
+	}
+
+	SECTION( "threaded" ) {
+		check_batch(perft_positions(BATCH_THREADING_MIN + 5));
+	}
+}
+
+TEST_CASE("evaluate returns compute_eval on eval cache hits", "[evaluate]") {
+	endgame::initialize();
+	init_eval_tables();
+	ht::invalidate_eval_caches();
+
+	int mismatches = 0;
+	int missed_hits = 0;
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		walk(pos, 2, [&](const Position& p) {
+			Score expected = compute_eval(p);
+			Score first = evaluate(p);
+			unsigned long hits = ht::eval_cache().hits;
+			Score second = evaluate(p);
+			if (ht::eval_cache().hits != hits + 1) {
+				missed_hits++;
+			}
+			if ((first != expected || second != expected) && mismatches++ == 0) {
+				UNSCOPED_INFO("first mismatch: " << notation::to_aligned_fen(p));
+			}
+		});
+	}
+	CHECK(mismatches == 0);
+	CHECK(missed_hits == 0);
+}
@@ -0,0 +1,112 @@
+#include "catch2.hpp"
+
+#include <string>
+#include <vector>
+
+#include "movegen.h"
+#include "notation.h"
+#include "position.h"
+#include "test_utils.h"
+
+TEST_CASE("move_allowed accepts exactly the legal moves", "[movegen]") {
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		int mismatches = 0;
+		walk(pos, 2, [&mismatches](const Position& p) {
+			std::vector<Move> legal;
+			gen_legal_moves(p, legal);
+			std::vector<bool> is_legal(1 << 16, false);
+			for (Move move : legal) {
+				is_legal[move] = true;
+			}
+			// every 16-bit value, including the ones that are not a valid encoding
+			for (unsigned m = 0; m < (1 << 16); m++) {
+				if (move_allowed(p, (Move) m) != is_legal[m]) {
+					if (mismatches++ == 0) {
+						UNSCOPED_INFO("first mismatch: move " << m << " in " << notation::to_aligned_fen(p));
+					}
+				}
+			}
+		});
+		INFO("root: " << fen);
+		CHECK(mismatches == 0);
+	}
+}
+
+TEST_CASE("gives_check matches make_move and is_checking", "[movegen]") {
+	SECTION( "perft positions" ) {
+		for (const std::string& fen : PERFT_FENS) {
+			Position pos = fen_position(fen);
+			int mismatches = 0;
+			walk(pos, 2, [&mismatches](Position& p) {
+				std::vector<Move> moves;
+				gen_legal_moves(p, moves);
+				for (Move move : moves) {
+					bool gives_check = p.gives_check(move);
+					p.make_move(move);
+					bool checking = p.is_checking();
+					p.unmake_move(move);
+					if (gives_check != checking && mismatches++ == 0) {
+						UNSCOPED_INFO("first mismatch: move " << move << " in " << notation::to_aligned_fen(p));
+					}
+				}
+			});
+			INFO("root: " << fen);
+			CHECK(mismatches == 0);
+		}
+	}
+
+	SECTION( "discovered check" ) {
+		Position p = fen_position("4k3/8/8/8/8/8/4B3/K3R3 w - - 0 1");
+		REQUIRE( p.gives_check(create_normal_move(SQ_E2, SQ_D3)) );
+		REQUIRE( p.gives_check(create_normal_move(SQ_E2, SQ_B5)) );
+		REQUIRE_FALSE( p.gives_check(create_normal_move(SQ_E1, SQ_D1)) );
+	}
+
+	SECTION( "en passant removes the blocking pawn" ) {
+		Position p = fen_position("8/8/8/k2pP2R/8/8/8/4K3 w - d6 0 1");
+		REQUIRE( p.gives_check(create_enpassant(SQ_E5, SQ_D6)) );
+		REQUIRE_FALSE( p.gives_check(create_normal_move(SQ_E5, SQ_E6)) );
+	}
+
+	SECTION( "castling rook gives check" ) {
+		Position p = fen_position("5k2/8/8/8/8/8/8/4K2R w K - 0 1");
+		REQUIRE( p.gives_check(create_castling_move(WHITE, KINGSIDE)) );
+		p = fen_position("3k4/8/8/8/8/8/8/R3K3 w Q - 0 1");
+		REQUIRE( p.gives_check(create_castling_move(WHITE, QUEENSIDE)) );
+		p = fen_position("6k1/8/8/8/8/8/8/4K2R w K - 0 1");
+		REQUIRE_FALSE( p.gives_check(create_castling_move(WHITE, KINGSIDE)) );
+	}
+
+	SECTION( "promotions" ) {
+		Position p = fen_position("8/2k1P3/8/8/8/8/8/K7 w - - 0 1");
+		REQUIRE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, KNIGHT)) );
+		REQUIRE_FALSE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, QUEEN)) );
+		p = fen_position("k7/4P3/8/8/8/8/8/K7 w - - 0 1");
+		REQUIRE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, QUEEN)) );
+		REQUIRE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, ROOK)) );
+		REQUIRE_FALSE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, BISHOP)) );
+		REQUIRE_FALSE( p.gives_check(create_promotion_move(SQ_E7, SQ_E8, KNIGHT)) );
+	}
+}
+
+TEST_CASE("to_aligned_fen round-trips through load_fen", "[notation]") {
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		walk(pos, 2, [](const Position& p) {
+			std::string aligned = notation::to_aligned_fen(p);
+			Position loaded = fen_position(aligned);
+			INFO(aligned);
+			REQUIRE( notation::to_aligned_fen(loaded) == aligned );
+			REQUIRE( loaded.get_hash() == p.get_hash() );
+			REQUIRE( loaded.get_castling_rights() == p.get_castling_rights() );
+			for (Color c : {WHITE, BLACK}) {
+				for (BoardSide side : {KINGSIDE, QUEENSIDE}) {
+					if (p.has_castling_rights(utils::to_castling_rights(c, side))) {
+						REQUIRE( loaded.get_castling_rook_source(c, side) == p.get_castling_rook_source(c, side) );
+					}
+				}
+			}
+		});
+	}
+}
@@ -0,0 +1,169 @@
+#include "catch2.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "nnue.h"
+#include "position.h"
+#include "test_utils.h"
+
+namespace {
+
+const char* NET_PATH = "nnue_test.bin";
+
+// A network with small random weights, written in the format documented in nnue.h. The weights
+// are large enough that both clipped ReLUs clip some of their inputs.
+struct TestNet {
+	std::vector<int16_t> l1_weights = std::vector<int16_t>(nnue::N_INPUTS * nnue::N_HIDDEN);
+	std::vector<int16_t> l1_biases = std::vector<int16_t>(nnue::N_HIDDEN);
+	std::vector<int16_t> l2_weights = std::vector<int16_t>(nnue::N_L2 * 2 * nnue::N_HIDDEN);
+	std::vector<int32_t> l2_biases = std::vector<int32_t>(nnue::N_L2);
+	std::vector<int16_t> out_weights = std::vector<int16_t>(nnue::N_L2);
+	int32_t out_bias;
+
+	TestNet() {
+		std::mt19937 rng(12345);
+		auto fill = [&rng](auto& v, int lo, int hi) {
+			std::uniform_int_distribution<int> dist(lo, hi);
+			for (auto& x : v) {
+				x = dist(rng);
+			}
+		};
+		fill(l1_weights, -40, 40);
+		fill(l1_biases, -60, 160);
+		fill(l2_weights, -32, 32);
+		fill(l2_biases, -nnue::QA * nnue::QB, nnue::QA * nnue::QB);
+		fill(out_weights, -64, 64);
+		out_bias = std::uniform_int_distribution<int>(-2000, 2000)(rng);
+	}
+
+	void write(const std::string& path, bool truncated = false) const {
+		std::ofstream os(path, std::ios::binary);
+		auto put = [&os](const auto& v) {
+			os.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(v[0]));
+		};
+		os.write("ZGKMNN01", 8);
+		const int32_t dims[3] = {nnue::N_INPUTS, nnue::N_HIDDEN, nnue::N_L2};
+		os.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+		put(l1_weights);
+		put(l1_biases);
+		put(l2_weights);
+		put(l2_biases);
+		if (truncated) {
+			return;
+		}
+		put(out_weights);
+		os.write(reinterpret_cast<const char*>(&out_bias), sizeof(out_bias));
+	}
+
+	// forward pass straight from the documented architecture, without incremental updates
+	Score evaluate(const Position& pos) const {
+		int32_t acc[N_COLORS][nnue::N_HIDDEN];
+		for (Color perspective : {WHITE, BLACK}) {
+			std::copy(l1_biases.begin(), l1_biases.end(), acc[perspective]);
+			for (Color c : {WHITE, BLACK}) {
+				for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType) (pt + 1)) {
+					Bitboard bb = pos.get_bitboard(c, pt);
+					while (bb) {
+						int sq = bboard::bitscan_fwd_remove(bb);
+						int rel_sq = perspective == WHITE ? sq : sq ^ 56;
+						int feature = ((c != perspective) * 6 + pt) * 64 + rel_sq;
+						for (int i = 0; i < nnue::N_HIDDEN; i++) {
+							acc[perspective][i] += l1_weights[feature * nnue::N_HIDDEN + i];
+						}
+					}
+				}
+			}
+		}
+
+		Color us = pos.get_side_to_move();
+		int32_t l1_out[2 * nnue::N_HIDDEN];
+		for (int i = 0; i < nnue::N_HIDDEN; i++) {
+			l1_out[i] = std::clamp(acc[us][i], 0, nnue::QA);
+			l1_out[nnue::N_HIDDEN + i] = std::clamp(acc[!us][i], 0, nnue::QA);
+		}
+		int64_t output = out_bias;
+		for (int j = 0; j < nnue::N_L2; j++) {
+			int32_t sum = l2_biases[j];
+			for (int i = 0; i < 2 * nnue::N_HIDDEN; i++) {
+				sum += l1_out[i] * l2_weights[j * 2 * nnue::N_HIDDEN + i];
+			}
+			output += std::clamp(sum / nnue::QA, 0, nnue::QB) * out_weights[j];
+		}
+		return (Score) (output * nnue::OUTPUT_SCALE / (nnue::QB * nnue::QB));
+	}
+};
+
+bool accumulator_matches_refresh(const Position& pos) {
+	Position fresh = pos;
+	fresh.refresh_accumulator();
+	return std::memcmp(&fresh.get_accumulator(), &pos.get_accumulator(), sizeof(nnue::Accumulator)) == 0;
+}
+}  // namespace
+
+TEST_CASE("a loaded network evaluates like the reference forward pass", "[nnue]") {
+	TestNet net;
+	net.write(NET_PATH);
+	REQUIRE( nnue::load(NET_PATH) );
+	REQUIRE( nnue::is_loaded() );
+
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		INFO(fen);
+		CHECK( nnue::evaluate(pos.get_accumulator(), pos.get_side_to_move()) == net.evaluate(pos) );
+	}
+
+	SECTION( "a truncated file keeps the previous network" ) {
+		net.write(NET_PATH, true);
+		CHECK_FALSE( nnue::load(NET_PATH) );
+		REQUIRE( nnue::is_loaded() );
+		Position pos = fen_position(PERFT_FENS[1]);
+		CHECK( nnue::evaluate(pos.get_accumulator(), pos.get_side_to_move()) == net.evaluate(pos) );
+	}
+
+	nnue::unload();
+	CHECK_FALSE( nnue::is_loaded() );
+	std::remove(NET_PATH);
+}
+
+TEST_CASE("incremental accumulator updates match a full refresh", "[nnue]") {
+	TestNet net;
+	net.write(NET_PATH);
+	REQUIRE( nnue::load(NET_PATH) );
+
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		int mismatches = 0;
+		walk(pos, 2, [&mismatches](Position& p) {
+			if (!accumulator_matches_refresh(p)) {
+				mismatches++;
+			}
+			// one more ply, undone with restore() instead of unmake_move()
+			std::vector<Move> moves;
+			gen_legal_moves(p, moves);
+			for (Move move : moves) {
+				PositionSnapshot saved = p.snapshot();
+				p.make_move(move);
+				if (!accumulator_matches_refresh(p)) {
+					mismatches++;
+				}
+				p.restore(saved);
+				if (!accumulator_matches_refresh(p)) {
+					mismatches++;
+				}
+			}
+		});
+		INFO(fen);
+		CHECK(mismatches == 0);
+	}
+
+	nnue::unload();
+	std::remove(NET_PATH);
+}
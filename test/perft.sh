@@ -13,8 +13,9 @@ echo "perft testing started"
 
 cat << EOF > perft.exp
    set timeout 10
-   lassign \$argv pos depth result
+   lassign \$argv pos depth result variant
    spawn ./out/zgkm.exe
+   if {\$variant eq "chess960"} {send "setoption name UCI_Chess960 value true\\n"}
    send "position \$pos\\ngo perft \$depth\\n"
    expect "\$result" {} timeout {exit 1}
    send "quit\\n"
@@ -28,6 +29,13 @@ expect perft.exp "fen r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq
 expect perft.exp "fen rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8" 5 89941194 > /dev/null
 expect perft.exp "fen r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10" 5 164075551 > /dev/null
 
+# Chess960, castling rights in Shredder-FEN
+expect perft.exp "fen bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9" 5 8146062 chess960 > /dev/null
+expect perft.exp "fen 2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9" 5 16253601 chess960 > /dev/null
+expect perft.exp "fen b1q1rrkb/pppppppp/3nn3/8/P7/1PPP4/4PPPP/BQNNRKRB w GE - 1 9" 5 6417013 chess960 > /dev/null
+expect perft.exp "fen qbbnnrkr/2pp2pp/p7/1p2pp2/8/P3PP2/1PPP1KPP/QBBNNR1R w hf - 0 9" 5 9183776 chess960 > /dev/null
+expect perft.exp "fen 1nbbnrkr/p1p1ppp1/3p4/1p3P1p/3Pq2P/8/PPP1P1P1/QNBBNRKR w HFhf - 0 9" 5 34030312 chess960 > /dev/null
+
 rm perft.exp
 
 echo "perft testing OK"
@@ -0,0 +1,141 @@
+#include "catch2.hpp"
+
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "hash.h"
+#include "movegen.h"
+#include "notation.h"
+#include "position.h"
+#include "test_utils.h"
+#include "utils.h"
+
+namespace {
+
+// Count the positions of the perft trees where good(pos) fails. Positions are reached with
+// make_move and unmake_move (walk()) and, one ply further, with make_move and restore().
+template <typename F>
+int count_failures(F good) {
+	int failures = 0;
+	auto check = [&failures, &good](const Position& p) {
+		if (!good(p) && failures++ == 0) {
+			UNSCOPED_INFO("first failure: " << notation::to_aligned_fen(p));
+		}
+	};
+	for (const std::string& fen : PERFT_FENS) {
+		Position pos = fen_position(fen);
+		walk(pos, 2, [&check](Position& p) {
+			check(p);
+			std::vector<Move> moves;
+			gen_legal_moves(p, moves);
+			for (Move move : moves) {
+				PositionSnapshot saved = p.snapshot();
+				p.make_move(move);
+				check(p);
+				p.restore(saved);
+				check(p);
+			}
+		});
+	}
+	return failures;
+}
+
+ZobristKey pawn_hash(const Position& pos) {
+	ZobristKey hash = 0;
+	for (Color c : {WHITE, BLACK}) {
+		Bitboard pawns = pos.get_bitboard(c, PAWN);
+		while (pawns) {
+			hash ^= zobrist::get_key(bboard::bitscan_fwd_remove(pawns), PAWN, c);
+		}
+	}
+	return hash;
+}
+
+ZobristKey material_hash(const Position& pos) {
+	ZobristKey hash = 0;
+	for (Color c : {WHITE, BLACK}) {
+		for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType) (pt + 1)) {
+			for (int n = 0; n < utils::popcount(pos.get_bitboard(c, pt)); n++) {
+				hash ^= zobrist::get_material_key(c, pt, n);
+			}
+		}
+	}
+	return hash;
+}
+
+// the attack mask of c, as Position::get_attack_mask() computed it before AttackInfo
+Bitboard attack_mask(const Position& pos, Color c) {
+	// sliders see through the enemy king
+	Bitboard occ = pos.get_all_bitboard() & ~pos.get_bitboard(utils::opposite_color(c), KING);
+	Bitboard mask = 0;
+	for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType) (pt + 1)) {
+		Bitboard pieces = pos.get_bitboard(c, pt);
+		while (pieces) {
+			Square sq = bboard::bitscan_fwd_remove(pieces);
+			switch (pt) {
+			case PAWN: mask |= bboard::pawn_attacks(sq, c); break;
+			case KNIGHT: mask |= bboard::knight_attacks(sq); break;
+			case BISHOP: mask |= bboard::bishop_attacks(sq, occ); break;
+			case ROOK: mask |= bboard::rook_attacks(sq, occ); break;
+			case QUEEN: mask |= bboard::bishop_attacks(sq, occ) | bboard::rook_attacks(sq, occ); break;
+			default: mask |= bboard::king_attacks(sq); break;
+			}
+		}
+	}
+	return mask;
+}
+}  // namespace
+
+TEST_CASE("pawn hash matches a recomputation", "[position]") {
+	CHECK(count_failures([](const Position& p) {
+		return p.get_pawn_hash() == pawn_hash(p);
+	}) == 0);
+}
+
+TEST_CASE("material hash matches a recomputation", "[position]") {
+	CHECK(count_failures([](const Position& p) {
+		return p.get_material_hash() == material_hash(p);
+	}) == 0);
+
+	SECTION( "more pieces of one kind than promotion allows" ) {
+		Position pos = fen_position("NNNNNNNN/NNNNNNNN/NNNNNNNN/8/8/8/4K3/k7 w - - 0 1");
+		CHECK(pos.get_material_hash() == material_hash(pos));
+		Position fewer = fen_position("NNNNNNNN/NNNNNNNN/NNNNNNN1/8/8/8/4K3/k7 w - - 0 1");
+		CHECK(fewer.get_material_hash() != pos.get_material_hash());
+	}
+}
+
+TEST_CASE("get_attacks matches the attack mask of each piece", "[position]") {
+	CHECK(count_failures([](const Position& p) {
+		for (Color c : {WHITE, BLACK}) {
+			const AttackInfo& info = p.get_attacks(c);
+			Bitboard by_type = 0;
+			for (PieceType pt = PAWN; pt != ANY_PIECE; pt = (PieceType) (pt + 1)) {
+				by_type |= info.by_type[pt];
+			}
+			if (info.all != attack_mask(p, c) || by_type != info.all || p.get_attack_mask(c) != info.all) {
+				return false;
+			}
+		}
+		return true;
+	}) == 0);
+}
+
+TEST_CASE("cached checkers and pins match a recomputation", "[position]") {
+	CHECK(count_failures([](const Position& p) {
+		Color us = p.get_side_to_move();
+		Square king_sq = bboard::bitscan_fwd(p.get_bitboard(us, KING));
+		if (p.get_checkers() != p.get_attackers(king_sq, utils::opposite_color(us))) {
+			return false;
+		}
+		for (Color c : {WHITE, BLACK}) {
+			Bitboard pinners;
+			Bitboard pinned = absolute_pins(p, c, pinners);
+			if (p.get_pinned(c) != pinned || p.get_pinners(c) != pinners) {
+				return false;
+			}
+		}
+		return true;
+	}) == 0);
+}
@@ -0,0 +1,64 @@
+#include "catch2.hpp"
+
+#include <set>
+#include <string>
+
+#include "hash.h"
+#include "search.h"
+#include "test_utils.h"
+#include "threading.h"
+
+namespace {
+
+// nodes searched from fen to depth with params, on a fresh table
+unsigned long search_nodes(const std::string& fen, int depth, const SearchParams& params) {
+	ht::Table table(1 << 16);
+	thread::Thread searcher;
+	searcher.set_silent(true);
+	searcher.set_table(&table);
+	searcher.set_position(fen_position(fen));
+	searcher.set_search_params(params);
+	searcher.reset();
+	SearchLimit limit = {};
+	limit.depth = depth;
+	searcher.set_search_limit(limit);
+	searcher.start_search();
+	searcher.wait_for_search();
+	return searcher.get_state().nodes;
+}
+}  // namespace
+
+TEST_CASE("search parameter specs are consistent", "[search]") {
+	const SearchParams defaults;
+	std::set<std::string> names;
+	for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+		const SearchParamSpec& spec = SEARCH_PARAM_SPECS[i];
+		INFO(spec.name);
+		CHECK(names.insert(spec.name).second);
+		for (int j = 0; j < i; j++) {
+			CHECK(SEARCH_PARAM_SPECS[j].field != spec.field);
+		}
+		CHECK(spec.min <= defaults.*spec.field);
+		CHECK(defaults.*spec.field <= spec.max);
+		CHECK(spec.spsa_step > 0);
+		CHECK(spec.spsa_step <= spec.max - spec.min);
+	}
+}
+
+TEST_CASE("search parameters reach the search", "[search]") {
+	thread::Thread searcher;
+	for (int i = 0; i < N_SEARCH_PARAMS; i++) {
+		const SearchParamSpec& spec = SEARCH_PARAM_SPECS[i];
+		SearchParams params;
+		params.*spec.field = spec.max;
+		searcher.set_search_params(params);
+		INFO(spec.name);
+		CHECK(searcher.get_search_params().*spec.field == spec.max);
+	}
+
+	// kiwipete has checks within a few plies, so the extension limit changes the tree
+	const std::string& kiwipete = PERFT_FENS[1];
+	SearchParams no_extensions;
+	no_extensions.max_check_extensions = 0;
+	CHECK(search_nodes(kiwipete, 3, SearchParams{}) != search_nodes(kiwipete, 3, no_extensions));
+}
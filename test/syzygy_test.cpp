@@ -0,0 +1,70 @@
+#include "catch2.hpp"
+
+#include <cstdlib>
+#include <string>
+
+#include "position.h"
+#include "syzygy.h"
+#include "test_utils.h"
+
+namespace {
+
+syzygy::WDLScore wdl(const std::string& fen) {
+	Position pos = fen_position(fen);
+	syzygy::ProbeState result;
+	syzygy::WDLScore score = syzygy::probe_wdl(pos, result);
+	INFO(fen);
+	REQUIRE( result != syzygy::PROBE_FAIL );
+	return score;
+}
+
+int dtz(const std::string& fen) {
+	Position pos = fen_position(fen);
+	syzygy::ProbeState result;
+	int score = syzygy::probe_dtz(pos, result);
+	INFO(fen);
+	REQUIRE( result != syzygy::PROBE_FAIL );
+	return score;
+}
+}  // namespace
+
+// The tables are not part of the repository: set SYZYGY_PATH to a directory with the 3- and
+// 4-piece tables to run these.
+TEST_CASE("probes 3- and 4-piece tables", "[syzygy]") {
+	const char* path = std::getenv("SYZYGY_PATH");
+	if (!path) {
+		WARN("SYZYGY_PATH is not set, skipping");
+		return;
+	}
+	syzygy::init(path);
+	if (syzygy::max_pieces() < 4) {
+		WARN("no 4-piece tables in SYZYGY_PATH, skipping");
+		syzygy::init("");
+		return;
+	}
+
+	SECTION( "3 pieces" ) {
+		REQUIRE( wdl("8/8/8/4k3/8/8/8/KQ6 w - - 0 1") == syzygy::WDL_WIN );
+		REQUIRE( wdl("8/8/8/4k3/8/8/8/KQ6 b - - 0 1") == syzygy::WDL_LOSS );
+		REQUIRE( wdl("8/8/8/4k3/8/8/8/KN6 w - - 0 1") == syzygy::WDL_DRAW );
+		REQUIRE( wdl("4k3/8/4K3/4P3/8/8/8/8 b - - 0 1") == syzygy::WDL_LOSS );
+		REQUIRE( wdl("k7/8/2K5/P7/8/8/8/8 w - - 0 1") == syzygy::WDL_DRAW );
+
+		REQUIRE( dtz("8/8/8/4k3/8/8/8/KQ6 w - - 0 1") > 0 );
+		REQUIRE( dtz("8/8/8/4k3/8/8/8/KQ6 b - - 0 1") < 0 );
+		REQUIRE( dtz("8/8/8/4k3/8/8/8/KN6 w - - 0 1") == 0 );
+		// promoting is the zeroing move
+		REQUIRE( dtz("8/4P3/8/8/8/8/8/k3K3 w - - 0 1") == 1 );
+	}
+
+	SECTION( "4 pieces" ) {
+		REQUIRE( wdl("3r4/8/8/4k3/8/8/8/KQ6 w - - 0 1") == syzygy::WDL_WIN );
+		REQUIRE( wdl("8/8/8/4k3/8/8/8/KBN5 w - - 0 1") == syzygy::WDL_WIN );
+		REQUIRE( wdl("1r6/8/8/4k3/8/8/8/R3K3 w - - 0 1") == syzygy::WDL_DRAW );
+
+		REQUIRE( dtz("8/8/8/4k3/8/8/8/KBN5 w - - 0 1") > 0 );
+		REQUIRE( dtz("1r6/8/8/4k3/8/8/8/R3K3 w - - 0 1") == 0 );
+	}
+
+	syzygy::init("");
+}
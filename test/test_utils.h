@@ -0,0 +1,45 @@
+#pragma once
+/* Helpers shared by the test files */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "movegen.h"
+#include "position.h"
+
+inline Position fen_position(const std::string& fen) {
+	std::istringstream iss(fen);
+	return Position(iss);
+}
+
+// the positions of test/perft.sh, the last five are Chess960
+inline const std::vector<std::string> PERFT_FENS = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"bqnb1rkr/pp3ppp/3ppn2/2p5/5P2/P2P4/NPP1P1PP/BQ1BNRKR w HFhf - 2 9",
+	"2nnrbkr/p1qppppp/8/1ppb4/6PP/3PP3/PPP2P2/BQNNRBKR w HEhe - 1 9",
+	"b1q1rrkb/pppppppp/3nn3/8/P7/1PPP4/4PPPP/BQNNRKRB w GE - 1 9",
+	"qbbnnrkr/2pp2pp/p7/1p2pp2/8/P3PP2/1PPP1KPP/QBBNNR1R w hf - 0 9",
+	"1nbbnrkr/p1p1ppp1/3p4/1p3P1p/3Pq2P/8/PPP1P1P1/QNBBNRKR w HFhf - 0 9",
+};
+
+// call visit on every position of the legal move tree of pos to depth
+template <typename F>
+void walk(Position& pos, int depth, F visit) {
+	visit(pos);
+	if (depth == 0) {
+		return;
+	}
+	std::vector<Move> moves;
+	gen_legal_moves(pos, moves);
+	for (Move move : moves) {
+		pos.make_move(move);
+		walk(pos, depth - 1, visit);
+		pos.unmake_move(move);
+	}
+}
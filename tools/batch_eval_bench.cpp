@@ -0,0 +1,110 @@
+/*
+ * Benchmark of evaluate_batch against calling compute_eval once per position.
+ *
+ * Usage: out/batch_eval_bench.exe [-n positions] [-r repetitions]
+ *
+ * Builds n positions by random playouts from a few start positions, then scores all of them with
+ * a compute_eval loop, with evaluate_batch in chunks too small to be threaded (SIMD lanes only), and
+ * with one evaluate_batch call (SIMD lanes and threads). Prints positions per second and checks
+ * that all three agree.
+ */
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "endgame.h"
+#include "evaluate.h"
+#include "hash.h"
+#include "movegen.h"
+#include "position.h"
+#include "utils.h"
+
+namespace {
+
+const char* FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+constexpr int N_FENS = sizeof(FENS) / sizeof(FENS[0]);
+constexpr int MAX_PLIES = 60;
+
+std::vector<Position> random_positions(size_t n) {
+    utils::PRNG rng(0x9E3779B97F4A7C15ULL);
+    std::vector<Position> positions;
+    positions.reserve(n);
+    std::vector<Move> moves;
+    while (positions.size() < n) {
+        std::istringstream iss(FENS[positions.size() % N_FENS]);
+        Position pos(iss);
+        int plies = rng.rand64() % MAX_PLIES;
+        for (int ply = 0; ply < plies; ply++) {
+            moves.clear();
+            gen_legal_moves(pos, moves);
+            if (moves.empty()) {
+                break;
+            }
+            pos.make_move(moves[rng.rand64() % moves.size()]);
+        }
+        positions.push_back(pos);
+    }
+    return positions;
+}
+
+template <typename F>
+void run(const char* name, const std::vector<Position>& positions, std::vector<Score>& out, int reps, F eval) {
+    utils::Timer timer;
+    for (int rep = 0; rep < reps; rep++) {
+        eval(positions.data(), out.data(), positions.size());
+    }
+    double elapsed = timer.elapsed_secs();
+    std::printf("%-24s %8.2f M positions/s\n", name, positions.size() * reps / elapsed / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t n = 20000;
+    int reps = 20;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "-n") {
+            n = std::max(1, std::stoi(argv[i + 1]));
+        } else if (flag == "-r") {
+            reps = std::max(1, std::stoi(argv[i + 1]));
+        } else {
+            std::fprintf(stderr, "Unknown flag '%s'\n", flag.c_str());
+            return 1;
+        }
+    }
+    bboard::initialize();
+    zobrist::initialize();
+    endgame::initialize();
+    init_eval_tables();
+
+    std::vector<Position> positions = random_positions(n);
+    std::vector<Score> single(n), lanes(n), threaded(n);
+    // alternate so that neither always runs first
+    for (int round = 0; round < 2; round++) {
+        run("compute_eval", positions, single, reps, [](const Position* pos, Score* out, size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                out[i] = compute_eval(pos[i]);
+            }
+        });
+        run("evaluate_batch (lanes)", positions, lanes, reps, [](const Position* pos, Score* out, size_t count) {
+            for (size_t i = 0; i < count; i += BATCH_THREADING_MIN - 1) {
+                evaluate_batch(pos + i, out + i, std::min(BATCH_THREADING_MIN - 1, count - i));
+            }
+        });
+        run("evaluate_batch", positions, threaded, reps, evaluate_batch);
+    }
+
+    if (lanes != single || threaded != single) {
+        std::fprintf(stderr, "evaluate_batch does not match compute_eval\n");
+        return 1;
+    }
+    return 0;
+}
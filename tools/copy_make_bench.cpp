@@ -0,0 +1,94 @@
+/*
+ * Benchmark of undoing moves with Position::unmake_move against restoring a PositionSnapshot
+ * (copy-make).
+ *
+ * Usage: out/copy_make_bench.exe [-d depth]
+ *
+ * Runs perft on a few positions both ways, making every move down to the leaves so that the undo
+ * dominates, and prints the moves made per second. USE_COPY_MAKE in types.h picks the one the
+ * search uses.
+ */
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "hash.h"
+#include "movegen.h"
+#include "position.h"
+#include "utils.h"
+
+namespace {
+
+const char* FENS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
+template <bool COPY_MAKE>
+U64 perft(Position& pos, int depth, std::vector<Move>* move_lists) {
+    if (depth == 0) {
+        return 1;
+    }
+    std::vector<Move>& moves = move_lists[0];
+    moves.clear();
+    gen_legal_moves(pos, moves);
+    U64 count = 0;
+    for (Move move : moves) {
+        if (COPY_MAKE) {
+            PositionSnapshot saved = pos.snapshot();
+            pos.make_move(move);
+            count += perft<COPY_MAKE>(pos, depth - 1, move_lists + 1);
+            pos.restore(saved);
+        } else {
+            pos.make_move(move);
+            count += perft<COPY_MAKE>(pos, depth - 1, move_lists + 1);
+            pos.unmake_move(move);
+        }
+    }
+    return count;
+}
+
+template <bool COPY_MAKE>
+void run(const char* name, int depth) {
+    std::vector<std::vector<Move>> move_lists(depth);
+    U64 nodes = 0;
+    utils::Timer timer;
+    for (const char* fen : FENS) {
+        std::istringstream iss(fen);
+        Position pos(iss);
+        nodes += perft<COPY_MAKE>(pos, depth, move_lists.data());
+    }
+    double elapsed = timer.elapsed_secs();
+    std::printf("%-12s %12llu nodes %8.2f M nodes/s\n", name, (unsigned long long) nodes,
+                nodes / elapsed / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int depth = 4;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "-d") {
+            depth = std::max(1, std::stoi(argv[i + 1]));
+        } else {
+            std::fprintf(stderr, "Unknown flag '%s'\n", flag.c_str());
+            return 1;
+        }
+    }
+    bboard::initialize();
+    zobrist::initialize();
+
+    std::printf("sizeof(PositionSnapshot) = %zu, sizeof(Position) = %zu\n", sizeof(PositionSnapshot),
+                sizeof(Position));
+    // alternate so that neither always runs first
+    for (int rep = 0; rep < 2; rep++) {
+        run<false>("make/unmake", depth);
+        run<true>("copy-make", depth);
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Generator for the precomputed magics in bitboard.cpp.
+ *
+ * Usage: out/gen_magics.exe
+ *
+ * Searches for the bishop and rook magics from scratch, as the engine used to do at startup, and
+ * prints them as a drop-in replacement for B_MAGIC_NUMBERS and R_MAGIC_NUMBERS. Only needs to be
+ * rerun when the relevant occupancy masks or the table layout change.
+ */
+#include <cstdio>
+
+#include "bitboard.h"
+
+namespace {
+
+void print_magics(const char* name, const Bitboard magics[64]) {
+    std::printf("const Bitboard %s[64] = {\n", name);
+    for (int sq = 0; sq < 64; sq++) {
+        std::printf("%s0x%016llxULL,%s", sq % 4 == 0 ? "    " : " ", (unsigned long long) magics[sq],
+                    sq % 4 == 3 ? "\n" : "");
+    }
+    std::printf("};\n");
+}
+
+}  // namespace
+
+int main() {
+    Bitboard b_magics[64];
+    Bitboard r_magics[64];
+    bboard::search_magics(b_magics, r_magics);
+
+    std::printf("// generated by tools/gen_magics.cpp (make magics)\n");
+    print_magics("B_MAGIC_NUMBERS", b_magics);
+    print_magics("R_MAGIC_NUMBERS", r_magics);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Benchmark of slider attack lookups with the shared attack table of bitboard.h against a plain
+ * layout with one attack set per magic index.
+ *
+ * Usage: out/slider_bench.exe [-n millions of lookups]
+ *
+ * Both layouts are indexed by the same magics (or PEXT in a BMI2=1 build). The squares and
+ * occupancies are random, so every part of the tables is hit, as in a search.
+ */
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bitboard.h"
+#include "utils.h"
+
+namespace {
+
+constexpr int N_SAMPLES = 1 << 16;
+
+// one attack set per magic index, the squares' slices laid out one after another
+struct PlainTable {
+    std::vector<Bitboard> attacks;
+    size_t b_offsets[64];
+    size_t r_offsets[64];
+
+    PlainTable() : attacks(bboard::B_TABLE_SZ + bboard::R_TABLE_SZ) {
+        size_t offset = 0;
+        for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
+            b_offsets[sq] = offset;
+            offset = fill(sq, offset, bboard::b_magics[sq], bboard::bishop_attacks);
+        }
+        for (Square sq = SQ_A1; sq <= SQ_H8; sq++) {
+            r_offsets[sq] = offset;
+            offset = fill(sq, offset, bboard::r_magics[sq], bboard::rook_attacks);
+        }
+    }
+
+    // fill the slice of sq at offset from the shared table and return the end of the slice
+    size_t fill(Square sq, size_t offset, const bboard::MagicInfo& m, Bitboard (*lookup)(Square, Bitboard)) {
+        Bitboard n = 0ULL;
+        size_t size = 0;
+        do {
+            attacks[offset + m.get_index(n)] = lookup(sq, n);
+            size++;
+            n = (n - m.occupancy_mask) & m.occupancy_mask;
+        } while (n != 0ULL);
+        return offset + size;
+    }
+
+    inline Bitboard bishop_attacks(Square sq, Bitboard occ) const {
+        return attacks[b_offsets[sq] + bboard::b_magics[sq].get_index(occ)];
+    }
+
+    inline Bitboard rook_attacks(Square sq, Bitboard occ) const {
+        return attacks[r_offsets[sq] + bboard::r_magics[sq].get_index(occ)];
+    }
+};
+
+// time rounds over the samples and print the lookups per second
+template <typename Lookup>
+void run(const char* name, size_t bytes, int rounds, const std::vector<Square>& squares,
+         const std::vector<Bitboard>& occupancies, Lookup lookup) {
+    utils::Timer timer;
+    Bitboard checksum = 0ULL;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < N_SAMPLES; i++) {
+            checksum ^= lookup(squares[i], occupancies[i]);
+        }
+    }
+    double elapsed = timer.elapsed_secs();
+    double lookups = 2. * rounds * N_SAMPLES;
+    std::printf("%-8s %8zu KB %10.1f M lookups/s (checksum %016llx)\n", name, bytes >> 10,
+                lookups / elapsed / 1e6, (unsigned long long) checksum);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    double millions = 200;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "-n") {
+            millions = std::stod(argv[i + 1]);
+        } else {
+            std::fprintf(stderr, "Unknown flag '%s'\n", flag.c_str());
+            return 1;
+        }
+    }
+    bboard::initialize();
+    PlainTable plain;
+
+    utils::PRNG prng(1);
+    std::vector<Square> squares(N_SAMPLES);
+    std::vector<Bitboard> occupancies(N_SAMPLES);
+    for (int i = 0; i < N_SAMPLES; i++) {
+        squares[i] = (Square) (prng.rand64() % 64);
+        // about a quarter of the squares occupied
+        occupancies[i] = prng.rand64() & prng.rand64();
+    }
+    // each round looks up a bishop and a rook per sample
+    int rounds = std::max(1, (int) (millions * 1e6 / (2. * N_SAMPLES)));
+
+    size_t shared_bytes = sizeof(bboard::slider_attacks) + sizeof(bboard::b_attack_refs) +
+                          sizeof(bboard::r_attack_refs);
+    size_t plain_bytes = plain.attacks.size() * sizeof(Bitboard);
+    // alternate so that neither layout always runs on a cold cache
+    for (int rep = 0; rep < 2; rep++) {
+        run("shared", shared_bytes, rounds, squares, occupancies, [](Square sq, Bitboard occ) {
+            return bboard::bishop_attacks(sq, occ) ^ bboard::rook_attacks(sq, occ);
+        });
+        run("plain", plain_bytes, rounds, squares, occupancies, [&plain](Square sq, Bitboard occ) {
+            return plain.bishop_attacks(sq, occ) ^ plain.rook_attacks(sq, occ);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,415 @@
+/*
+ * Texel tuner for the PeSTO parameters in evaluate.cpp: mg_value, eg_value, the twelve
+ * piece-square tables and gamephaseInc.
+ *
+ * Usage: out/tune.exe <dataset> [-t threads] [-i iterations] [-lr rate] [-o output]
+ *
+ * Each line of the dataset holds a FEN (or EPD) followed somewhere on the line by the game result,
+ * either as "1-0", "0-1", "1/2-1/2" or as "[1.0]", "[0.5]", "[0.0]" (from white's point of view).
+ * Parameters are optimized with Adam on the mean squared error between the game result and the
+ * logistic win probability of the evaluation, with the gradient computed in parallel over shards of
+ * the data. The result is written as a drop-in replacement for the table block of evaluate.cpp.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bitboard.h"
+#include "endgame.h"
+#include "evaluate.h"
+#include "hash.h"
+#include "position.h"
+#include "utils.h"
+
+namespace {
+
+constexpr int N_PT = 6;
+
+// parameter layout
+constexpr int MG_VALUE = 0;
+constexpr int EG_VALUE = MG_VALUE + N_PT;
+constexpr int MG_PSQT = EG_VALUE + N_PT;
+constexpr int EG_PSQT = MG_PSQT + N_PT * 64;
+constexpr int PHASE_INC = EG_PSQT + N_PT * 64;
+constexpr int N_PARAMS = PHASE_INC + N_PT;
+
+// phase increments are an order of magnitude smaller than centipawn values
+constexpr double PHASE_LR_SCALE = 0.01;
+
+// Compact training sample. Everything that is not tuned is folded into mg_fixed/eg_fixed.
+struct Sample {
+    float result;          // 1 for a white win, 0.5 for a draw, 0 for a black win
+    int16_t mg_fixed;      // untuned terms, from white's point of view
+    int16_t eg_fixed;
+    uint8_t counts[N_PT];  // number of pieces of each type, both colors
+    uint8_t n_pieces;
+    uint8_t eg_scale;      // out of endgame::SCALE_NORMAL
+    // bit 9: black piece; bits 6-8: piece type; bits 0-5: piece-square table index
+    uint16_t pieces[32];
+};
+
+struct Gradient {
+    std::vector<double> grad = std::vector<double>(N_PARAMS, 0.);
+    double loss = 0.;
+};
+
+bool parse_result(const std::string& line, float& result) {
+    if (line.find("1/2-1/2") != std::string::npos || line.find("[0.5]") != std::string::npos) {
+        result = 0.5f;
+    } else if (line.find("1-0") != std::string::npos || line.find("[1.0]") != std::string::npos) {
+        result = 1.f;
+    } else if (line.find("0-1") != std::string::npos || line.find("[0.0]") != std::string::npos) {
+        result = 0.f;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Everything but material and piece-square terms is taken from trace_eval() as a fixed offset.
+// Return false for positions that a specialized endgame evaluator scores instead.
+bool make_sample(const Position& pos, float result, Sample& s) {
+    s = Sample{};
+    s.result = result;
+
+    EvalTrace trace;
+    trace_eval(pos, trace);
+    if (trace.endgame) {
+        return false;
+    }
+    int mg = 0;
+    int eg = 0;
+    for (int term = TERM_IMBALANCE; term < N_EVAL_TERMS; term++) {
+        mg += trace.mg[term][WHITE] - trace.mg[term][BLACK];
+        eg += trace.eg[term][WHITE] - trace.eg[term][BLACK];
+    }
+    s.mg_fixed = (int16_t) mg;
+    s.eg_fixed = (int16_t) eg;
+    s.eg_scale = (uint8_t) trace.eg_scale;
+
+    for (Color c : {WHITE, BLACK}) {
+        for (PieceType pt = PAWN; pt <= KING; pt = (PieceType)(pt + 1)) {
+            Bitboard bb = pos.get_bitboard(c, pt);
+            while (bb && s.n_pieces < 32) {
+                Square sq = bboard::bitscan_fwd_remove(bb);
+                Square psqt_sq = c == WHITE ? sq : utils::flip(sq);
+                s.pieces[s.n_pieces++] = (uint16_t)((c << 9) | (pt << 6) | psqt_sq);
+                s.counts[pt]++;
+            }
+        }
+    }
+    return true;
+}
+
+void parse_shard(const std::vector<std::string>& lines, size_t start, size_t end,
+                 std::vector<Sample>& out) {
+    for (size_t i = start; i < end; i++) {
+        float result;
+        if (!parse_result(lines[i], result)) {
+            continue;
+        }
+        std::istringstream iss(lines[i]);
+        Position pos(iss);
+        Sample s;
+        if (make_sample(pos, result, s)) {
+            out.push_back(s);
+        }
+    }
+}
+
+std::vector<Sample> load_dataset(const std::string& path, int n_threads) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not open '" << path << "'" << std::endl;
+        exit(1);
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty()) {
+            lines.push_back(line);
+        }
+    }
+
+    std::vector<std::vector<Sample>> shards(n_threads);
+    std::vector<std::thread> workers;
+    size_t chunk = (lines.size() + n_threads - 1) / n_threads;
+    for (int t = 0; t < n_threads; t++) {
+        size_t start = std::min(lines.size(), t * chunk);
+        size_t end = std::min(lines.size(), start + chunk);
+        workers.emplace_back(parse_shard, std::cref(lines), start, end, std::ref(shards[t]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::vector<Sample> samples;
+    for (auto& shard : shards) {
+        samples.insert(samples.end(), shard.begin(), shard.end());
+    }
+    return samples;
+}
+
+std::vector<double> initial_params() {
+    std::vector<double> params(N_PARAMS);
+    for (int pt = 0; pt < N_PT; pt++) {
+        params[MG_VALUE + pt] = mg_value[pt];
+        params[EG_VALUE + pt] = eg_value[pt];
+        params[PHASE_INC + pt] = gamephaseInc[pt * 2];
+        for (int sq = 0; sq < 64; sq++) {
+            params[MG_PSQT + pt * 64 + sq] = mg_pesto_table[pt][sq];
+            params[EG_PSQT + pt * 64 + sq] = eg_pesto_table[pt][sq];
+        }
+    }
+    return params;
+}
+
+struct SampleEval {
+    double eval;
+    double mg;
+    double eg;
+    double phase;  // clamped to [0, 24]
+    bool phase_clamped;
+    double eg_scale;
+};
+
+inline SampleEval evaluate(const Sample& s, const std::vector<double>& params) {
+    SampleEval e{};
+    e.mg = s.mg_fixed;
+    e.eg = s.eg_fixed;
+    for (int i = 0; i < s.n_pieces; i++) {
+        int sign = (s.pieces[i] >> 9) ? -1 : 1;
+        int pt = (s.pieces[i] >> 6) & 7;
+        int sq = s.pieces[i] & 63;
+        e.mg += sign * (params[MG_VALUE + pt] + params[MG_PSQT + pt * 64 + sq]);
+        e.eg += sign * (params[EG_VALUE + pt] + params[EG_PSQT + pt * 64 + sq]);
+    }
+    double phase = 0.;
+    for (int pt = 0; pt < N_PT; pt++) {
+        phase += s.counts[pt] * params[PHASE_INC + pt];
+    }
+    e.phase_clamped = phase <= 0. || phase >= 24.;
+    e.phase = std::clamp(phase, 0., 24.);
+    e.eg_scale = (double) s.eg_scale / endgame::SCALE_NORMAL;
+    e.eval = (e.mg * e.phase + e.eg * e.eg_scale * (24. - e.phase)) / 24.;
+    return e;
+}
+
+inline double sigmoid(double k, double eval) {
+    return 1. / (1. + std::pow(10., -k * eval / 400.));
+}
+
+void shard_gradient(const std::vector<Sample>& samples, size_t start, size_t end,
+                    const std::vector<double>& params, double k, bool with_grad, Gradient& out) {
+    for (size_t i = start; i < end; i++) {
+        const Sample& s = samples[i];
+        SampleEval e = evaluate(s, params);
+        double p = sigmoid(k, e.eval);
+        double err = p - s.result;
+        out.loss += err * err;
+        if (!with_grad) {
+            continue;
+        }
+
+        // d(loss)/d(eval)
+        double g = 2. * err * p * (1. - p) * k * std::log(10.) / 400.;
+        double g_mg = g * e.phase / 24.;
+        double g_eg = g * e.eg_scale * (24. - e.phase) / 24.;
+        for (int j = 0; j < s.n_pieces; j++) {
+            int sign = (s.pieces[j] >> 9) ? -1 : 1;
+            int pt = (s.pieces[j] >> 6) & 7;
+            int sq = s.pieces[j] & 63;
+            out.grad[MG_VALUE + pt] += sign * g_mg;
+            out.grad[MG_PSQT + pt * 64 + sq] += sign * g_mg;
+            out.grad[EG_VALUE + pt] += sign * g_eg;
+            out.grad[EG_PSQT + pt * 64 + sq] += sign * g_eg;
+        }
+        if (!e.phase_clamped) {
+            double g_phase = g * (e.mg - e.eg * e.eg_scale) / 24.;
+            for (int pt = 0; pt < N_PT; pt++) {
+                out.grad[PHASE_INC + pt] += g_phase * s.counts[pt];
+            }
+        }
+    }
+}
+
+// mean loss and gradient over all samples, computed in parallel over n_threads shards
+Gradient compute_gradient(const std::vector<Sample>& samples, const std::vector<double>& params,
+                          double k, bool with_grad, int n_threads) {
+    std::vector<Gradient> partials(n_threads);
+    std::vector<std::thread> workers;
+    size_t chunk = (samples.size() + n_threads - 1) / n_threads;
+    for (int t = 0; t < n_threads; t++) {
+        size_t start = std::min(samples.size(), t * chunk);
+        size_t end = std::min(samples.size(), start + chunk);
+        workers.emplace_back(shard_gradient, std::cref(samples), start, end, std::cref(params), k,
+                             with_grad, std::ref(partials[t]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    Gradient total;
+    for (const Gradient& partial : partials) {
+        total.loss += partial.loss;
+        for (int i = 0; i < N_PARAMS; i++) {
+            total.grad[i] += partial.grad[i];
+        }
+    }
+    total.loss /= samples.size();
+    for (double& g : total.grad) {
+        g /= samples.size();
+    }
+    return total;
+}
+
+// find the sigmoid scaling constant that best fits the current evaluation (golden-section search)
+double fit_k(const std::vector<Sample>& samples, const std::vector<double>& params, int n_threads) {
+    const double ratio = (std::sqrt(5.) - 1.) / 2.;
+    double lo = 0.05;
+    double hi = 3.;
+    for (int i = 0; i < 40; i++) {
+        double k1 = hi - ratio * (hi - lo);
+        double k2 = lo + ratio * (hi - lo);
+        double loss1 = compute_gradient(samples, params, k1, false, n_threads).loss;
+        double loss2 = compute_gradient(samples, params, k2, false, n_threads).loss;
+        if (loss1 < loss2) {
+            hi = k2;
+        } else {
+            lo = k1;
+        }
+    }
+    return (lo + hi) / 2.;
+}
+
+void print_array(std::ostream& os, const char* name, const std::vector<double>& params, int offset) {
+    os << "int " << name << "[64] = {\n";
+    for (int rank = 0; rank < 8; rank++) {
+        os << "   ";
+        for (int file = 0; file < 8; file++) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), " %4d,", (int) std::lround(params[offset + rank * 8 + file]));
+            os << buf;
+        }
+        os << "\n";
+    }
+    os << "};\n\n";
+}
+
+// write the parameters in the same layout as evaluate.cpp
+void write_tables(std::ostream& os, const std::vector<double>& params) {
+    static const char* NAMES[N_PT] = {"pawn", "knight", "bishop", "rook", "queen", "king"};
+    for (int offset : {MG_VALUE, EG_VALUE}) {
+        os << (offset == MG_VALUE ? "int mg_value[6] = {" : "int eg_value[6] = {");
+        for (int pt = 0; pt < N_PT; pt++) {
+            os << " " << (pt == KING ? 0 : std::lround(params[offset + pt])) << (pt + 1 < N_PT ? "," : "");
+        }
+        os << "};\n";
+    }
+    os << "\n/* piece/sq tables */\n/* Texel-tuned by tools/tune.cpp */\n\n";
+    for (int pt = 0; pt < N_PT; pt++) {
+        print_array(os, ("mg_" + std::string(NAMES[pt]) + "_table").c_str(), params, MG_PSQT + pt * 64);
+        print_array(os, ("eg_" + std::string(NAMES[pt]) + "_table").c_str(), params, EG_PSQT + pt * 64);
+    }
+    os << "int gamephaseInc[12] = {";
+    for (int pt = 0; pt < N_PT; pt++) {
+        long inc = std::max(0L, std::lround(params[PHASE_INC + pt]));
+        os << inc << "," << inc << (pt + 1 < N_PT ? "," : "");
+    }
+    os << "};\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <dataset> [-t threads] [-i iterations] [-lr rate] [-o output]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string dataset = argv[1];
+    int n_threads = std::max(1u, std::thread::hardware_concurrency());
+    int iterations = 1000;
+    double lr = 1.;
+    std::string output;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "-t") {
+            n_threads = std::max(1, std::stoi(argv[i + 1]));
+        } else if (flag == "-i") {
+            iterations = std::stoi(argv[i + 1]);
+        } else if (flag == "-lr") {
+            lr = std::stod(argv[i + 1]);
+        } else if (flag == "-o") {
+            output = argv[i + 1];
+        } else {
+            std::cerr << "Unknown flag '" << flag << "'" << std::endl;
+            return 1;
+        }
+    }
+
+    bboard::initialize();
+    zobrist::initialize();
+    endgame::initialize();
+    init_eval_tables();
+
+    utils::Timer timer;
+    std::vector<Sample> samples = load_dataset(dataset, n_threads);
+    if (samples.empty()) {
+        std::cerr << "No labeled positions in '" << dataset << "'" << std::endl;
+        return 1;
+    }
+    std::cerr << "Loaded " << samples.size() << " positions (" << sizeof(Sample) << " bytes each) in "
+              << timer.elapsed_secs() << "s" << std::endl;
+
+    std::vector<double> params = initial_params();
+    double k = fit_k(samples, params, n_threads);
+    std::cerr << "K = " << k << ", initial loss "
+              << compute_gradient(samples, params, k, false, n_threads).loss << std::endl;
+
+    // Adam
+    const double beta1 = 0.9;
+    const double beta2 = 0.999;
+    const double eps = 1e-8;
+    std::vector<double> m(N_PARAMS, 0.);
+    std::vector<double> v(N_PARAMS, 0.);
+    timer.zero();
+    for (int it = 1; it <= iterations; it++) {
+        Gradient gradient = compute_gradient(samples, params, k, true, n_threads);
+        for (int i = 0; i < N_PARAMS; i++) {
+            const double g = gradient.grad[i];
+            m[i] = beta1 * m[i] + (1. - beta1) * g;
+            v[i] = beta2 * v[i] + (1. - beta2) * g * g;
+            double m_hat = m[i] / (1. - std::pow(beta1, it));
+            double v_hat = v[i] / (1. - std::pow(beta2, it));
+            double rate = i >= PHASE_INC ? lr * PHASE_LR_SCALE : lr;
+            params[i] -= rate * m_hat / (std::sqrt(v_hat) + eps);
+        }
+        // the king's value is implied by its piece-square table
+        params[MG_VALUE + KING] = 0.;
+        params[EG_VALUE + KING] = 0.;
+
+        if (it % 50 == 0 || it == iterations) {
+            std::cerr << "iteration " << it << " loss " << gradient.loss << " ("
+                      << timer.elapsed_secs() << "s)" << std::endl;
+        }
+    }
+
+    if (output.empty()) {
+        write_tables(std::cout, params);
+    } else {
+        std::ofstream out(output);
+        write_tables(out, params);
+        std::cerr << "Wrote tables to " << output << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Run the fastest engine variant built by `make variants` that this CPU supports, passing on all
+# arguments. Expects the variants next to this script.
+
+dir=$(dirname "$0")
+flags=" $(grep -m1 '^flags' /proc/cpuinfo 2>/dev/null | cut -d: -f2) "
+
+has() {
+  for flag in "$@"; do
+    [[ "$flags" == *" $flag "* ]] || return 1
+  done
+}
+
+if has popcnt bmi1 bmi2 avx2; then
+  arch=avx2
+elif has popcnt bmi1 bmi2; then
+  arch=bmi2
+elif has popcnt; then
+  arch=popcnt
+else
+  arch=generic
+fi
+
+exec "$dir/zgkm-$arch.exe" "$@"